@@ -67,7 +67,9 @@ static PyObject* OpenMote_getState(OpenMote* self) {
    PyObject* ieee154e_dbg;
    PyObject* idmanager_vars;
    PyObject* openqueue_vars;
+   PyObject* openqueue_dbg;
    PyObject* opentimers_vars;
+   PyObject* opentimers_dbg;
    PyObject* random_vars;
    PyObject* openserial_vars;
    PyObject* scheduler_vars;
@@ -166,11 +168,21 @@ static PyObject* OpenMote_getState(OpenMote* self) {
    // TODO
    PyDict_SetItemString(returnVal, "openqueue_vars", openqueue_vars);
    
+   // openqueue_dbg
+   openqueue_dbg = PyDict_New();
+   // TODO
+   PyDict_SetItemString(returnVal, "openqueue_dbg", openqueue_dbg);
+   
    // opentimers_vars
    opentimers_vars = PyDict_New();
    // TODO
    PyDict_SetItemString(returnVal, "opentimers_vars", opentimers_vars);
    
+   // opentimers_dbg
+   opentimers_dbg = PyDict_New();
+   // TODO
+   PyDict_SetItemString(returnVal, "opentimers_dbg", opentimers_dbg);
+   
    // random_vars
    random_vars = PyDict_New();
    // TODO
@@ -188,8 +188,10 @@ struct OpenMote {
    // cross-layer
    idmanager_vars_t     idmanager_vars;
    openqueue_vars_t     openqueue_vars;
+   openqueue_dbg_t      openqueue_dbg;
    // drivers
    opentimers_vars_t    opentimers_vars;
+   opentimers_dbg_t     opentimers_dbg;
    random_vars_t        random_vars;
    openserial_vars_t    openserial_vars;
    // kernel
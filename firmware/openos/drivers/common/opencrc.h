@@ -0,0 +1,46 @@
+/**
+\brief Declaration of the "opencrc" driver, the CRC-16 engine.
+*/
+
+#ifndef __OPENCRC_H
+#define __OPENCRC_H
+
+#include "openwsn.h"
+
+/**
+\addtogroup drivers
+\{
+\addtogroup OpenCrc
+\{
+*/
+
+//=========================== define ==========================================
+
+/**
+\brief How the CRC is computed.
+
+All methods compute the same CRC-16, with the reflected CCITT polynomial
+(0x8408), as used by IEEE802.15.4 and HDLC. They trade speed for code size:
+- #OPENCRC_BITWISE shifts each bit in, no table.
+- #OPENCRC_TABLE processes a byte at a time, with a 512-byte table.
+- #OPENCRC_SLICE4 processes 4 bytes at a time, with 2kB of tables.
+*/
+#define OPENCRC_BITWISE      0
+#define OPENCRC_TABLE        1
+#define OPENCRC_SLICE4       2
+
+#define OPENCRC_METHOD       OPENCRC_TABLE
+
+//=========================== typedef =========================================
+
+//=========================== prototypes ======================================
+
+uint16_t opencrc_update(uint16_t crc, uint8_t* buf, uint16_t len);
+uint16_t opencrc_updateByte(uint16_t crc, uint8_t byte);
+
+/**
+\}
+\}
+*/
+
+#endif
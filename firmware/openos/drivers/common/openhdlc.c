@@ -1,20 +0,0 @@
-/**
-\brief Definition of the "openserial" driver.
-
-\author Min Ting <tingm417@gmail.com>, October 2012.
-\author Fabien Chraim <chraim@eecs.berkeley.edu>, October 2012.
-*/
-
-#include "openhdlc.h"
-
-//=========================== variables =======================================
-
-//=========================== prototypes ======================================
-
-//=========================== public ==========================================
-
-uint16_t crcIteration(uint16_t crc, uint8_t byte) {
-   return (crc >> 8) ^ fcstab[(crc ^ byte) & 0xff];
-}
-
-//=========================== private =========================================
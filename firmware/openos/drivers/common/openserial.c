@@ -20,6 +20,8 @@
 #include "uart.h"
 #include "opentimers.h"
 #include "openhdlc.h"
+#include "opencrc.h"
+#include "scheduler.h"
 
 //=========================== variables =======================================
 
@@ -59,7 +61,7 @@ void openserial_init() {
    openserial_vars.reqFrame[0]         = HDLC_FLAG;
    openserial_vars.reqFrame[1]         = SERFRAME_MOTE2PC_REQUEST;
    crc = HDLC_CRCINIT;
-   crc = crcIteration(crc,openserial_vars.reqFrame[1]);
+   crc = opencrc_updateByte(crc,openserial_vars.reqFrame[1]);
    crc = ~crc;
    openserial_vars.reqFrame[2]         = (crc>>0)&0xff;
    openserial_vars.reqFrame[3]         = (crc>>8)&0xff;
@@ -173,6 +175,11 @@ owerror_t openserial_printError(uint8_t calling_component, uint8_t error_code,
    // blink error LED, this is serious
    leds_error_toggle();
    
+   // keep the MAC timing trace which led to the error
+   if (calling_component==COMPONENT_IEEE802154E) {
+      ieee154e_freezeTrace();
+   }
+   
    return openserial_printInfoErrorCritical(
       SERFRAME_MOTE2PC_ERROR,
       calling_component,
@@ -311,6 +318,22 @@ void openserial_startOutput() {
          if (debugPrint_neighbors()==TRUE) {
             break;
          }
+      case STATUS_SCHEDULER:
+         if (debugPrint_scheduler()==TRUE) {
+            break;
+         }
+      case STATUS_OPENTIMERS:
+         if (debugPrint_opentimers()==TRUE) {
+            break;
+         }
+      case STATUS_CHANNELSTATS:
+         if (debugPrint_channelStats()==TRUE) {
+            break;
+         }
+      case STATUS_TRACE:
+         if (debugPrint_trace()==TRUE) {
+            break;
+         }
       default:
          DISABLE_INTERRUPTS();
          openserial_vars.debugPrintCounter=0;
@@ -442,7 +465,7 @@ inline void outputHdlcOpen() {
 inline void outputHdlcWrite(uint8_t b) {
    
    // iterate through CRC calculator
-   openserial_vars.outputCrc = crcIteration(openserial_vars.outputCrc,b);
+   openserial_vars.outputCrc = opencrc_updateByte(openserial_vars.outputCrc,b);
    
    // add byte to buffer
    if (b==HDLC_FLAG || b==HDLC_ESCAPE) {
@@ -500,7 +523,7 @@ inline void inputHdlcWrite(uint8_t b) {
       openserial_vars.inputBufFill++;
       
       // iterate through CRC calculator
-      openserial_vars.inputCrc = crcIteration(openserial_vars.inputCrc,b);
+      openserial_vars.inputCrc = opencrc_updateByte(openserial_vars.inputCrc,b);
    }
 }
 /**
@@ -4,6 +4,11 @@
 This driver uses a single hardware timer, which it virtualizes to support
 at most MAX_NUM_TIMERS timers.
 
+The running timers are kept in a delta list, sorted by expiration time, where
+each timer stores the number of ticks after the previous one. Expiring a timer
+only touches the head of the list; starting one walks the running timers which
+expire before it.
+
 \author Xavi Vilajosana <xvilajosana@eecs.berkeley.edu>, March 2012.
  */
 
@@ -11,17 +16,24 @@ at most MAX_NUM_TIMERS timers.
 #include "opentimers.h"
 #include "bsp_timer.h"
 #include "leds.h"
+#include "openserial.h"
 
 //=========================== define ==========================================
 
 //=========================== variables =======================================
 
 opentimers_vars_t opentimers_vars;
+opentimers_dbg_t  opentimers_dbg;
 //uint32_t counter; //counts the elapsed time.
 
 //=========================== prototypes ======================================
 
 void opentimers_timer_callback();
+uint32_t opentimers_toTicks(time_type_t timetype, uint32_t duration);
+void opentimers_insert(opentimer_id_t id, uint32_t ticks);
+void opentimers_remove(opentimer_id_t id);
+uint32_t opentimers_remaining(opentimer_id_t id);
+PORT_TIMER_WIDTH opentimers_nextTimeout();
 
 //=========================== public ==========================================
 
@@ -35,13 +47,22 @@ void opentimers_init(){
 
    // initialize local variables
    opentimers_vars.running=FALSE;
+   opentimers_vars.first=OPENTIMERS_NONE;
+   opentimers_vars.numFree=0;
+   opentimers_vars.inCallback=FALSE;
+   memset(&opentimers_dbg,0,sizeof(opentimers_dbg_t));
    for (i=0;i<MAX_NUM_TIMERS;i++) {
       opentimers_vars.timersBuf[i].period_ticks       = 0;
       opentimers_vars.timersBuf[i].ticks_remaining    = 0;
       opentimers_vars.timersBuf[i].type               = TIMER_ONESHOT;
       opentimers_vars.timersBuf[i].isrunning          = FALSE;
       opentimers_vars.timersBuf[i].callback           = NULL;
+      opentimers_vars.timersBuf[i].prio               = TASKPRIO_NONE;
       opentimers_vars.timersBuf[i].hasExpired         = FALSE;
+      opentimers_vars.timersBuf[i].slack_ticks        = 0;
+      opentimers_vars.timersBuf[i].prev               = OPENTIMERS_NONE;
+      opentimers_vars.timersBuf[i].next               = OPENTIMERS_NONE;
+      opentimers_vars.freeStack[opentimers_vars.numFree++] = MAX_NUM_TIMERS-1-i;
    }
 
    // set callback for bsp_timers module
@@ -53,9 +74,9 @@ void opentimers_init(){
 
 The timer works as follows:
 - currentTimeout is the number of ticks before the next timer expires.
-- if a new timer is inserted, we check that it is not earlier than the soonest
-- if it is earliest, replace it
-- if not, insert it in the list
+- the timer is inserted in the list of running timers, after the timers which
+  expire no later than it.
+- if it is earliest, the hardware timer is re-scheduled.
 
 \param duration Number milli-seconds after which the timer will fire.
 \param type     The type of timer, indicating whether it's a one-shot or a period timer.
@@ -66,117 +87,197 @@ The timer works as follows:
 \returns TOO_MANY_TIMERS_ERROR if the timer could NOT be started.
  */
 opentimer_id_t opentimers_start(uint32_t duration, timer_type_t type, time_type_t timetype, opentimers_cbt callback) {
+   return opentimers_startWithSlack(duration,0,type,timetype,callback);
+}
 
-   uint8_t  id;
+/**
+\brief Start a timer which may fire late.
 
-   // find an unused timer
-   for (id=0; id<MAX_NUM_TIMERS && opentimers_vars.timersBuf[id].isrunning==TRUE; id++);
+Same as opentimers_start(), but the timer may fire up to slack after it
+expires. When the windows of several timers overlap, they are fired in a single
+wakeup, at the end of the earliest window. Use this for timers which do not
+need to be precise, so the board sleeps longer.
 
-   if (id<MAX_NUM_TIMERS) {
-      // we found an unused timer
+\param duration Number milli-seconds after which the timer will fire.
+\param slack    How much later than duration the timer may fire, in the same
+                unit as duration.
+\param type     The type of timer, indicating whether it's a one-shot or a period timer.
+\param callback The function to call when the timer fires.
 
-      // register the timer
-      if (timetype==TIME_MS) {
-         opentimers_vars.timersBuf[id].period_ticks      = duration*PORT_TICS_PER_MS;
-         opentimers_vars.timersBuf[id].wraps_remaining   = (duration*PORT_TICS_PER_MS/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-      } else if (timetype==TIME_TICS) {
-         opentimers_vars.timersBuf[id].period_ticks      = duration;
-         opentimers_vars.timersBuf[id].wraps_remaining   = (duration/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t  
-      } else {
-         while (1); //error
-      }
-      //if the number of ticks falls below a 16bit value, use it, otherwise set to max 16bit value
-      if(opentimers_vars.timersBuf[id].wraps_remaining==0){
-         if (timetype==TIME_MS){ 
-            opentimers_vars.timersBuf[id].ticks_remaining   = duration*PORT_TICS_PER_MS;
-         } else if (timetype==TIME_TICS) {
-            opentimers_vars.timersBuf[id].ticks_remaining   = duration;
-         } else {
-            // this should never happpen!
-   
-            // we can not print from within the drivers. Instead:
-            // blink the error LED
-            leds_error_blink();
-            // reset the board
-            board_reset();
-         }
-      }else{
-         opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-      }                                                   
-      opentimers_vars.timersBuf[id].type              = type;
-      opentimers_vars.timersBuf[id].isrunning         = TRUE;
-      opentimers_vars.timersBuf[id].callback          = callback;
-      opentimers_vars.timersBuf[id].hasExpired        = FALSE;
-
-      // re-schedule the running timer, if needed
-      if (
-            (opentimers_vars.running==FALSE)
-            ||
-            (opentimers_vars.timersBuf[id].ticks_remaining < opentimers_vars.currentTimeout)
-      ) {  
-         opentimers_vars.currentTimeout            = opentimers_vars.timersBuf[id].ticks_remaining;
-         if (opentimers_vars.running==FALSE) {
-            bsp_timer_reset();
-         }
-         bsp_timer_scheduleIn(opentimers_vars.timersBuf[id].ticks_remaining);
-      }
+\returns The id of the timer (which serves as a handler to stop it) if the
+         timer could be started.
+\returns TOO_MANY_TIMERS_ERROR if the timer could NOT be started.
+ */
+opentimer_id_t opentimers_startWithSlack(uint32_t duration, uint32_t slack, timer_type_t type, time_type_t timetype, opentimers_cbt callback) {
+   return opentimers_startTask(duration,slack,type,timetype,callback,TASKPRIO_NONE);
+}
 
-      opentimers_vars.running                         = TRUE;
+/**
+\brief Start a timer whose callback runs as a task.
 
-   } else {
+Same as opentimers_startWithSlack(), but when the timer fires, the callback is
+posted to the scheduler at priority prio, instead of being called from the
+timer ISR. This keeps the ISR short. A callback which is still pending when
+the timer fires again runs only once.
+
+\note The callback may run once after the timer is stopped, if the timer fired
+      before it was stopped.
+
+\param duration Number milli-seconds after which the timer will fire.
+\param slack    How much later than duration the timer may fire, in the same
+                unit as duration.
+\param type     The type of timer, indicating whether it's a one-shot or a period timer.
+\param callback The function to call when the timer fires.
+\param prio     The priority of the task calling callback, or TASKPRIO_NONE to
+                call it from the timer ISR, for timing-critical callbacks.
+
+\returns The id of the timer (which serves as a handler to stop it) if the
+         timer could be started.
+\returns TOO_MANY_TIMERS_ERROR if the timer could NOT be started.
+ */
+opentimer_id_t opentimers_startTask(uint32_t duration, uint32_t slack, timer_type_t type, time_type_t timetype, opentimers_cbt callback, task_prio_t prio) {
+
+   opentimer_id_t id;
+   uint32_t       ticks;
+   INTERRUPT_DECLARATION();
+
+   ticks = opentimers_toTicks(timetype,duration);
+   slack = opentimers_toTicks(timetype,slack);
+
+   DISABLE_INTERRUPTS();
+
+   // take an unused timer
+   if (opentimers_vars.numFree==0) {
+      ENABLE_INTERRUPTS();
       return TOO_MANY_TIMERS_ERROR;
    }
+   id = opentimers_vars.freeStack[--opentimers_vars.numFree];
+
+   // register the timer
+   opentimers_vars.timersBuf[id].period_ticks      = ticks;
+   opentimers_vars.timersBuf[id].type              = type;
+   opentimers_vars.timersBuf[id].isrunning         = TRUE;
+   opentimers_vars.timersBuf[id].callback          = callback;
+   opentimers_vars.timersBuf[id].hasExpired        = FALSE;
+   opentimers_vars.timersBuf[id].slack_ticks       = slack;
+   opentimers_vars.timersBuf[id].prio              = prio;
+   opentimers_insert(id,ticks);
+
+   ENABLE_INTERRUPTS();
 
    return id;
 }
 
 /**
-\brief Replace the period of a running timer.
+\brief Replace the period of a timer.
+
+The timer keeps its phase: its next deadline becomes its previous deadline (or
+the time it was started) plus the new period. If that is already passed, the
+timer fires as soon as possible.
  */
 void  opentimers_setPeriod(opentimer_id_t id,time_type_t timetype,uint32_t newDuration) {
-   if        (timetype==TIME_MS) {
-      opentimers_vars.timersBuf[id].period_ticks      = newDuration*PORT_TICS_PER_MS;
-      opentimers_vars.timersBuf[id].wraps_remaining   = (newDuration*PORT_TICS_PER_MS/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-   } else if (timetype==TIME_TICS) {
-      opentimers_vars.timersBuf[id].period_ticks      = newDuration;
-      opentimers_vars.timersBuf[id].wraps_remaining   = (newDuration/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-   } else {
-      // this should never happpen!
+   uint32_t ticks;
+   uint32_t remaining;
+   INTERRUPT_DECLARATION();
+
+   ticks = opentimers_toTicks(timetype,newDuration);
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.timersBuf[id].hasExpired==FALSE) {
+      if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
+         remaining = opentimers_remaining(id);
+         opentimers_remove(id);
+      } else {
+         remaining = opentimers_vars.timersBuf[id].ticks_remaining;
+      }
       
-      // we can not print from within the drivers. Instead:
-      // blink the error LED
-      leds_error_blink();
-      // reset the board
-      board_reset();
-   }
-   if(opentimers_vars.timersBuf[id].wraps_remaining==0) {
-      if        (timetype==TIME_MS){
-         opentimers_vars.timersBuf[id].ticks_remaining   = newDuration*PORT_TICS_PER_MS;
-      } else if (timetype==TIME_TICS){
-         opentimers_vars.timersBuf[id].ticks_remaining   = newDuration;
+      // move the deadline by the change of period
+      if (remaining+ticks>opentimers_vars.timersBuf[id].period_ticks) {
+         remaining = remaining+ticks-opentimers_vars.timersBuf[id].period_ticks;
+      } else {
+         remaining = 0;
+      }
+      
+      if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
+         opentimers_insert(id,remaining);
+      } else {
+         opentimers_vars.timersBuf[id].ticks_remaining = remaining;
       }
-   } else {
-      opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
    }
+   // else: called from within its callback, the ISR re-arms it with the new period
+   opentimers_vars.timersBuf[id].period_ticks = ticks;
+   ENABLE_INTERRUPTS();
 }
 
 /**
 \brief Stop a running timer.
 
 Sets the timer to "not running". the system recovers even if this was the next
-timer to expire.
+timer to expire. The ticks it had remaining are kept for opentimers_restart().
  */
 void opentimers_stop(opentimer_id_t id) {
-   opentimers_vars.timersBuf[id].isrunning=FALSE;
+   uint32_t       remaining;
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
+      opentimers_vars.timersBuf[id].isrunning = FALSE;
+      if (opentimers_vars.timersBuf[id].hasExpired==FALSE) {
+         remaining = opentimers_remaining(id);
+         opentimers_remove(id);
+         opentimers_vars.timersBuf[id].ticks_remaining = remaining;
+         opentimers_vars.freeStack[opentimers_vars.numFree++] = id;
+      }
+      // else: it is stopped from within its callback, the ISR releases it
+   }
+   ENABLE_INTERRUPTS();
 }
 
 /**
 \brief Restart a stop timer.
 
-Sets the timer to " running".
+Sets the timer to " running", with the ticks it had remaining when stopped.
  */
 void opentimers_restart(opentimer_id_t id) {
-   opentimers_vars.timersBuf[id].isrunning=TRUE;
+   uint8_t i;
+   INTERRUPT_DECLARATION();
+
+   DISABLE_INTERRUPTS();
+   if (opentimers_vars.timersBuf[id].isrunning==FALSE) {
+      if (opentimers_vars.timersBuf[id].hasExpired==TRUE) {
+         // restarted from within its callback, the ISR re-arms it
+         opentimers_vars.timersBuf[id].isrunning = TRUE;
+      } else {
+         // take it back from the unused timers, unless it was started again since
+         for (i=0;i<opentimers_vars.numFree && opentimers_vars.freeStack[i]!=id;i++);
+         if (i<opentimers_vars.numFree) {
+            opentimers_vars.freeStack[i] = opentimers_vars.freeStack[--opentimers_vars.numFree];
+            opentimers_vars.timersBuf[id].isrunning = TRUE;
+            opentimers_insert(id,opentimers_vars.timersBuf[id].ticks_remaining);
+         }
+      }
+   }
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief Trigger this module to print status information, over serial.
+
+debugPrint_* functions are used by the openserial module to continuously print
+status information about several modules in the OpenWSN stack.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_opentimers() {
+   opentimers_dbg_t temp;
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   memcpy(&temp,&opentimers_dbg,sizeof(opentimers_dbg_t));
+   ENABLE_INTERRUPTS();
+   
+   openserial_printStatus(STATUS_OPENTIMERS,(uint8_t*)&temp,sizeof(opentimers_dbg_t));
+   return TRUE;
 }
 
 
@@ -194,81 +295,100 @@ to expire.
 void opentimers_timer_callback() {
    
    opentimer_id_t   id;
-   PORT_TIMER_WIDTH min_timeout;
-   bool             found;
-    
-   // step 1. Identify expired timers
-   for(id=0; id<MAX_NUM_TIMERS; id++) {
-      if (opentimers_vars.timersBuf[id].isrunning==TRUE) {
-
-         if(opentimers_vars.currentTimeout >= opentimers_vars.timersBuf[id].ticks_remaining) {
-            // this timer has expired
-            //check to see if we have completed the whole timer, or we're just wrapping around the max 16bit value
-            if(opentimers_vars.timersBuf[id].wraps_remaining == 0){
-               // declare as so
-               opentimers_vars.timersBuf[id].hasExpired  = TRUE;
-            }else{
-               opentimers_vars.timersBuf[id].wraps_remaining--;
-               if(opentimers_vars.timersBuf[id].wraps_remaining == 0){
-                  //if we have fully wrapped around, then set the remainring ticks to the modulus of the total ticks and the max clock value
-                  opentimers_vars.timersBuf[id].ticks_remaining = (opentimers_vars.timersBuf[id].period_ticks) % MAX_TICKS_IN_SINGLE_CLOCK;
-               }else{
-                  opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-               }
-            }
-         } else {
-            // this timer is not expired
-
-            // update its counter
-            opentimers_vars.timersBuf[id].ticks_remaining -= opentimers_vars.currentTimeout;
-         }   
+   opentimer_id_t   expired;
+   uint32_t         elapsed;
+   uint32_t         late;
+   uint32_t         period;
+   uint32_t         overruns;
+   
+   if (opentimers_dbg.numWakeups<0xffff) {
+      opentimers_dbg.numWakeups++;
+   }
+   
+   // step 1. detach the expired timers, they are at the head of the list
+   elapsed = opentimers_vars.currentTimeout;
+   expired = OPENTIMERS_NONE;
+   while (
+         opentimers_vars.first!=OPENTIMERS_NONE &&
+         opentimers_vars.timersBuf[opentimers_vars.first].ticks_remaining<=elapsed
+      ) {
+      id       = opentimers_vars.first;
+      elapsed -= opentimers_vars.timersBuf[id].ticks_remaining;
+      if (expired==OPENTIMERS_NONE) {
+         expired = id;
+      } else if (
+            opentimers_vars.timersBuf[id].ticks_remaining>0 &&
+            opentimers_dbg.numWakeupsSaved<0xffff
+         ) {
+         // expires after the previous one, its slack saved a wakeup
+         opentimers_dbg.numWakeupsSaved++;
       }
+      // from now on, ticks_remaining is how late it fires
+      opentimers_vars.timersBuf[id].ticks_remaining = elapsed;
+      opentimers_vars.timersBuf[id].hasExpired  = TRUE;
+      opentimers_vars.first                     = opentimers_vars.timersBuf[id].next;
    }
-
-   // step 2. call callbacks of expired timers
-   for(id=0; id<MAX_NUM_TIMERS; id++) {
-      if (opentimers_vars.timersBuf[id].hasExpired==TRUE){
-
-         // call the callback
-         opentimers_vars.timersBuf[id].callback();
-         opentimers_vars.timersBuf[id].hasExpired     = FALSE;
-
-         // reload the timer, if applicable
-         if (opentimers_vars.timersBuf[id].type==TIMER_PERIODIC) {
-            opentimers_vars.timersBuf[id].wraps_remaining   = (opentimers_vars.timersBuf[id].period_ticks/MAX_TICKS_IN_SINGLE_CLOCK);//65535=maxValue of uint16_t
-            //if the number of ticks falls below a 16bit value, use it, otherwise set to max 16bit value
-            if(opentimers_vars.timersBuf[id].wraps_remaining==0)                                                
-               opentimers_vars.timersBuf[id].ticks_remaining   = opentimers_vars.timersBuf[id].period_ticks;
-            else
-               opentimers_vars.timersBuf[id].ticks_remaining = MAX_TICKS_IN_SINGLE_CLOCK;
-
-         } else {
-            opentimers_vars.timersBuf[id].isrunning   = FALSE;
-         }
+   if (expired!=OPENTIMERS_NONE) {
+      // id is the last expired timer, cut the list after it
+      opentimers_vars.timersBuf[id].next = OPENTIMERS_NONE;
+      if (opentimers_vars.first!=OPENTIMERS_NONE) {
+         opentimers_vars.timersBuf[opentimers_vars.first].prev = OPENTIMERS_NONE;
       }
-
    }
-
-   // step 3. find the minimum remaining timeout among running timers
-   found = FALSE;
-   for(id=0;id<MAX_NUM_TIMERS;id++) {
+   
+   // step 2. account for the elapsed time, which only changes the first delta
+   if (opentimers_vars.first!=OPENTIMERS_NONE) {
+      opentimers_vars.timersBuf[opentimers_vars.first].ticks_remaining -= elapsed;
+   }
+   
+   // step 3. call callbacks of expired timers
+   opentimers_vars.inCallback = TRUE;
+   while (expired!=OPENTIMERS_NONE) {
+      id      = expired;
+      expired = opentimers_vars.timersBuf[id].next;
+      
+      // call the callback, or post it
+      if (opentimers_vars.timersBuf[id].prio==TASKPRIO_NONE) {
+         opentimers_vars.timersBuf[id].callback();
+      } else {
+         scheduler_push_task_unique(
+            opentimers_vars.timersBuf[id].callback,
+            opentimers_vars.timersBuf[id].prio
+         );
+      }
+      opentimers_vars.timersBuf[id].hasExpired     = FALSE;
+      
+      // reload the timer, if applicable
       if (
-            opentimers_vars.timersBuf[id].isrunning==TRUE &&
-            (
-                  found==FALSE
-                  ||
-                  opentimers_vars.timersBuf[id].ticks_remaining < min_timeout
-            )
-      ) {
-         min_timeout    = opentimers_vars.timersBuf[id].ticks_remaining;
-         found          = TRUE;
+            opentimers_vars.timersBuf[id].type==TIMER_PERIODIC &&
+            opentimers_vars.timersBuf[id].isrunning==TRUE
+         ) {
+         // re-arm against the deadline it just reached, not the current time
+         late   = opentimers_vars.timersBuf[id].ticks_remaining;
+         period = opentimers_vars.timersBuf[id].period_ticks;
+         if (period>0 && late>=period) {
+            // it missed some deadlines, skip them
+            overruns = late/period;
+            late    %= period;
+            if (overruns<(uint32_t)(0xffff-opentimers_dbg.numOverruns)) {
+               opentimers_dbg.numOverruns += overruns;
+            } else {
+               opentimers_dbg.numOverruns  = 0xffff;
+            }
+         }
+         opentimers_insert(id,late<period ? period-late : 0);
+      } else {
+         opentimers_vars.timersBuf[id].isrunning       = FALSE;
+         opentimers_vars.timersBuf[id].ticks_remaining = 0;
+         opentimers_vars.freeStack[opentimers_vars.numFree++] = id;
       }
    }
-
+   opentimers_vars.inCallback = FALSE;
+   
    // step 4. schedule next timeout
-   if (found==TRUE) {
+   if (opentimers_vars.first!=OPENTIMERS_NONE) {
       // at least one timer pending
-      opentimers_vars.currentTimeout = min_timeout;
+      opentimers_vars.currentTimeout = opentimers_nextTimeout();
       bsp_timer_scheduleIn(opentimers_vars.currentTimeout);
    } else {
       // no more timers pending
@@ -276,3 +396,166 @@ void opentimers_timer_callback() {
    }
 }
 
+/**
+\brief Convert a duration into clock ticks.
+ */
+uint32_t opentimers_toTicks(time_type_t timetype, uint32_t duration) {
+   if        (timetype==TIME_MS) {
+      return duration*PORT_TICS_PER_MS;
+   } else if (timetype==TIME_TICS) {
+      return duration;
+   }
+   
+   // this should never happpen!
+   
+   // we can not print from within the drivers. Instead:
+   // blink the error LED
+   leds_error_blink();
+   // reset the board
+   board_reset();
+   return 0;
+}
+
+/**
+\brief Insert a timer in the list of running timers.
+
+It goes after all the timers which expire no later than it, so timers
+expiring at the same time fire in the order they were started. The hardware
+timer is re-scheduled if the new timer needs an earlier wakeup.
+
+\pre Called with interrupts disabled.
+
+\param id    The timer to insert.
+\param ticks The number of ticks before it expires, counted from the last
+             timeout.
+ */
+void opentimers_insert(opentimer_id_t id, uint32_t ticks) {
+   opentimer_id_t   prev;
+   opentimer_id_t   next;
+   PORT_TIMER_WIDTH timeout;
+   
+   // find its position, consuming the deltas of the timers before it
+   prev = OPENTIMERS_NONE;
+   next = opentimers_vars.first;
+   while (next!=OPENTIMERS_NONE && opentimers_vars.timersBuf[next].ticks_remaining<=ticks) {
+      ticks -= opentimers_vars.timersBuf[next].ticks_remaining;
+      prev   = next;
+      next   = opentimers_vars.timersBuf[next].next;
+   }
+   
+   // link it
+   opentimers_vars.timersBuf[id].ticks_remaining = ticks;
+   opentimers_vars.timersBuf[id].prev            = prev;
+   opentimers_vars.timersBuf[id].next            = next;
+   if (next!=OPENTIMERS_NONE) {
+      opentimers_vars.timersBuf[next].ticks_remaining -= ticks;
+      opentimers_vars.timersBuf[next].prev             = id;
+   }
+   if (prev!=OPENTIMERS_NONE) {
+      opentimers_vars.timersBuf[prev].next = id;
+   } else {
+      opentimers_vars.first                = id;
+   }
+   
+   // re-schedule the hardware timer, if needed
+   if (opentimers_vars.inCallback==TRUE) {
+      // the ISR schedules it when it returns
+      return;
+   }
+   timeout = opentimers_nextTimeout();
+   if (
+         (opentimers_vars.running==FALSE)
+         ||
+         (timeout < opentimers_vars.currentTimeout)
+   ) {
+      opentimers_vars.currentTimeout = timeout;
+      if (opentimers_vars.running==FALSE) {
+         bsp_timer_reset();
+      }
+      bsp_timer_scheduleIn(opentimers_vars.currentTimeout);
+   }
+   opentimers_vars.running = TRUE;
+}
+
+/**
+\brief Remove a timer from the list of running timers.
+
+Its delta is handed over to the next timer, so the ones after it keep their
+expiration time.
+
+\pre Called with interrupts disabled, on a timer in the list.
+ */
+void opentimers_remove(opentimer_id_t id) {
+   opentimer_id_t prev;
+   opentimer_id_t next;
+   
+   prev = opentimers_vars.timersBuf[id].prev;
+   next = opentimers_vars.timersBuf[id].next;
+   if (next!=OPENTIMERS_NONE) {
+      opentimers_vars.timersBuf[next].ticks_remaining += opentimers_vars.timersBuf[id].ticks_remaining;
+      opentimers_vars.timersBuf[next].prev             = prev;
+   }
+   if (prev!=OPENTIMERS_NONE) {
+      opentimers_vars.timersBuf[prev].next = next;
+   } else {
+      opentimers_vars.first                = next;
+   }
+   opentimers_vars.timersBuf[id].prev = OPENTIMERS_NONE;
+   opentimers_vars.timersBuf[id].next = OPENTIMERS_NONE;
+}
+
+/**
+\brief Number of ticks before a running timer expires.
+
+This is the sum of the deltas of the timers up to it in the list.
+
+\pre Called with interrupts disabled, with the timer in the list.
+
+\returns The number of ticks after the last timeout.
+ */
+uint32_t opentimers_remaining(opentimer_id_t id) {
+   opentimer_id_t i;
+   uint32_t       remaining;
+   
+   remaining = 0;
+   for (i=opentimers_vars.first;i!=id;i=opentimers_vars.timersBuf[i].next) {
+      remaining += opentimers_vars.timersBuf[i].ticks_remaining;
+   }
+   return remaining+opentimers_vars.timersBuf[id].ticks_remaining;
+}
+
+/**
+\brief Compute when the hardware timer should fire next.
+
+This is the end of the earliest slack window, when the first timer has to fire
+at the latest. All the timers expiring by then fire in that same wakeup, and
+this is within the window of each of them.
+
+\pre Called with interrupts disabled, with at least one running timer.
+
+\returns The number of ticks after the last timeout.
+ */
+PORT_TIMER_WIDTH opentimers_nextTimeout() {
+   opentimer_id_t id;
+   uint32_t       deadline;
+   uint32_t       timeout;
+   
+   id       = opentimers_vars.first;
+   deadline = opentimers_vars.timersBuf[id].ticks_remaining;
+   timeout  = deadline+opentimers_vars.timersBuf[id].slack_ticks;
+   for (id=opentimers_vars.timersBuf[id].next;id!=OPENTIMERS_NONE;id=opentimers_vars.timersBuf[id].next) {
+      deadline += opentimers_vars.timersBuf[id].ticks_remaining;
+      if (deadline>timeout) {
+         // this and the following timers expire after the wakeup
+         break;
+      }
+      if (deadline+opentimers_vars.timersBuf[id].slack_ticks<timeout) {
+         timeout = deadline+opentimers_vars.timersBuf[id].slack_ticks;
+      }
+   }
+   
+   if (timeout<MAX_TICKS_IN_SINGLE_CLOCK) {
+      return (PORT_TIMER_WIDTH)timeout;
+   }
+   return MAX_TICKS_IN_SINGLE_CLOCK;
+}
@@ -8,6 +8,7 @@
 #define __OPENTIMERS_H
 
 #include "openwsn.h"
+#include "scheduler.h"
 
 //=========================== define ==========================================
 
@@ -18,6 +19,8 @@
 
 #define TOO_MANY_TIMERS_ERROR     255
 
+#define OPENTIMERS_NONE           0xff // "no timer" in the list of running timers
+
 #define opentimer_id_t uint8_t
 
 typedef void (*opentimers_cbt)();
@@ -37,13 +40,18 @@ typedef enum {
 
 typedef struct {
    uint32_t             period_ticks;       // total number of clock ticks
-   PORT_TIMER_WIDTH     ticks_remaining;    // ticks remaining before elapses
-   uint16_t             wraps_remaining;    // the clock register is 16 bit, and can't count beyond 32k...
-                                            // so period_ticks = wraps_remaining*(32k or uint16_t)
+   uint32_t             ticks_remaining;    // while running, ticks after the previous timer in the
+                                            // list (after the last timeout for the first timer);
+                                            // while stopped, ticks remaining before it elapses;
+                                            // while expired, ticks it fired after its deadline
    timer_type_t         type;               // periodic or one-shot
    bool                 isrunning;          // is running?
    opentimers_cbt       callback;           // function to call when elapses
+   task_prio_t          prio;               // priority of the callback task, TASKPRIO_NONE to call it in the ISR
    bool                 hasExpired;         // whether the callback has to be called
+   uint32_t             slack_ticks;        // how late it may fire, to share a wakeup with other timers
+   opentimer_id_t       prev;               // previous timer in the list of running timers
+   opentimer_id_t       next;               // next timer in the list of running timers
 } opentimers_t;
 
 //=========================== module variables ================================
@@ -52,8 +60,20 @@ typedef struct {
    opentimers_t         timersBuf[MAX_NUM_TIMERS];
    bool                 running;
    PORT_TIMER_WIDTH     currentTimeout; // current timeout, in ticks
+   opentimer_id_t       first;          // running timer which expires first
+   opentimer_id_t       freeStack[MAX_NUM_TIMERS]; // timers which can be started
+   uint8_t              numFree;        // number of valid elements in freeStack
+   bool                 inCallback;     // the hardware timer is rescheduled when the ISR returns
 } opentimers_vars_t;
 
+PRAGMA(pack(1));
+typedef struct {
+   uint16_t             numWakeups;         // number of times the hardware timer fired
+   uint16_t             numWakeupsSaved;    // timers which fired in the wakeup of an earlier one
+   uint16_t             numOverruns;        // deadlines of periodic timers skipped because they fired too late
+} opentimers_dbg_t;
+PRAGMA(pack());
+
 //=========================== prototypes ======================================
 
 void           opentimers_init();
@@ -61,8 +81,20 @@ opentimer_id_t opentimers_start(uint32_t       duration,
                                 timer_type_t   type,
                                 time_type_t timetype,
                                 opentimers_cbt callback);
+opentimer_id_t opentimers_startWithSlack(uint32_t       duration,
+                                uint32_t       slack,
+                                timer_type_t   type,
+                                time_type_t timetype,
+                                opentimers_cbt callback);
+opentimer_id_t opentimers_startTask(uint32_t       duration,
+                                uint32_t       slack,
+                                timer_type_t   type,
+                                time_type_t timetype,
+                                opentimers_cbt callback,
+                                task_prio_t    prio);
 void           opentimers_setPeriod(opentimer_id_t id,time_type_t timetype, uint32_t       newPeriod);
 void           opentimers_stop(opentimer_id_t id);
 void           opentimers_restart(opentimer_id_t id);
+bool           debugPrint_opentimers();
 
 #endif
@@ -1,6 +1,12 @@
 /**
 \brief OpenOS scheduler.
 
+Pending tasks are kept in one FIFO per priority level. A bitmap records which
+priority levels have pending tasks; the highest priority pending task is
+found by counting the leading zeros in that bitmap. Pushing and popping a
+task are hence done in constant time, independently of the number of pending
+tasks.
+
 \author Thomas Watteyne <watteyne@eecs.berkeley.edu>, February 2012.
 */
 
@@ -9,48 +15,102 @@
 #include "board.h"
 #include "debugpins.h"
 #include "leds.h"
+#include "bsp_timer.h"
+#include "openserial.h"
 
 //=========================== variables =======================================
 
 scheduler_vars_t scheduler_vars;
 scheduler_dbg_t  scheduler_dbg;
 
+/**
+\brief Number of leading zeros in a 4-bit value.
+
+Used to select the highest priority non-empty FIFO without looping, on
+architectures which do not have a count-leading-zeros instruction.
+*/
+static const uint8_t scheduler_clz4[16] = {
+   4, 3, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
 //=========================== prototypes ======================================
 
-void consumeTask(uint8_t taskId);
+uint8_t scheduler_highestReadyPrio();
+bool    scheduler_handleOverflow(task_cbt cb, task_prio_t prio);
+taskList_item_t* scheduler_findPendingTask(task_cbt cb, task_prio_t prio);
+owerror_t        scheduler_insertTask(task_cbt cb, task_prio_t prio);
+#ifdef SCHEDULER_PROFILE
+void    scheduler_profileTask(taskList_item_t* task,
+                              PORT_TIMER_WIDTH startTime,
+                              PORT_TIMER_WIDTH endTime);
+#endif
 
 //=========================== public ==========================================
 
-void scheduler_init() {   
+void scheduler_init() {
+   uint8_t i;
    
    // initialization module variables
    memset(&scheduler_vars,0,sizeof(scheduler_vars_t));
    memset(&scheduler_dbg,0,sizeof(scheduler_dbg_t));
    
+   // chain all task containers into the free list
+   for (i=0;i<TASK_LIST_DEPTH-1;i++) {
+      scheduler_vars.taskBuf[i].next = &scheduler_vars.taskBuf[i+1];
+   }
+   scheduler_vars.freeList = &scheduler_vars.taskBuf[0];
+   
    // enable the scheduler's interrupt so SW can wake up the scheduler
    SCHEDULER_ENABLE_INTERRUPT();
 }
 
 void scheduler_start() {
    taskList_item_t* pThisTask;
+   taskFifo_t*      fifo;
+   uint8_t          prio;
+#ifdef SCHEDULER_PROFILE
+   PORT_TIMER_WIDTH startTime;
+#endif
+   INTERRUPT_DECLARATION();
+   
    while (1) {
-      while(scheduler_vars.task_list!=NULL) {
-         // there is still at least one task in the linked-list of tasks
-         
-         // the task to execute is the one at the head of the queue
-         pThisTask                = scheduler_vars.task_list;
-         
-         // shift the queue by one task
-         scheduler_vars.task_list = pThisTask->next;
-         
+      while(scheduler_vars.readyBitmap!=0) {
+         // there is still at least one task pending
+   
+         DISABLE_INTERRUPTS();
+   
+         // the task to execute is the head of the highest priority FIFO
+         prio                     = scheduler_highestReadyPrio();
+         fifo                     = &scheduler_vars.fifo[prio];
+         pThisTask                = fifo->head;
+   
+         // shift that FIFO by one task
+         fifo->head               = pThisTask->next;
+         if (fifo->head==NULL) {
+            fifo->tail            = NULL;
+            scheduler_vars.readyBitmap &= ~(1<<(TASKPRIO_MAX-1-prio));
+         }
+   
+         ENABLE_INTERRUPTS();
+   
          // execute the current task
+#ifdef SCHEDULER_PROFILE
+         startTime                = bsp_timer_get_currentValue();
+#endif
          pThisTask->cb();
-         
+#ifdef SCHEDULER_PROFILE
+         scheduler_profileTask(pThisTask,startTime,bsp_timer_get_currentValue());
+#endif
+   
          // free up this task container
+         DISABLE_INTERRUPTS();
          pThisTask->cb            = NULL;
          pThisTask->prio          = TASKPRIO_NONE;
-         pThisTask->next          = NULL;
+         pThisTask->count         = 0;
+         pThisTask->next          = scheduler_vars.freeList;
+         scheduler_vars.freeList  = pThisTask;
          scheduler_dbg.numTasksCur--;
+         ENABLE_INTERRUPTS();
       }
       debugpins_task_clr();
       board_sleep();
@@ -58,48 +118,345 @@ void scheduler_start() {
    }
 }
 
- void scheduler_push_task(task_cbt cb, task_prio_t prio) {
-   taskList_item_t*  taskContainer;
-   taskList_item_t** taskListWalker;
+ owerror_t scheduler_push_task(task_cbt cb, task_prio_t prio) {
+   owerror_t         outcome;
    INTERRUPT_DECLARATION();
    
    DISABLE_INTERRUPTS();
+   outcome = scheduler_insertTask(cb,prio);
+   ENABLE_INTERRUPTS();
+   
+   return outcome;
+}
+
+/**
+\brief Push a task, unless the same callback is already pending.
+
+Use this instead of scheduler_push_task() for tasks for which running the
+callback once is enough to handle all the pushes which happened since it last
+ran, typically tasks posted by periodic timers. If the same callback is
+already pending at the same priority, the push is merged into that pending
+task and does not consume a task container.
+
+\param[in] cb   The callback of the task.
+\param[in] prio The priority of the task.
+
+\returns The number of pushes pending for this callback, including this one,
+         or 0 if the task could not be pushed.
+*/
+uint8_t scheduler_push_task_unique(task_cbt cb, task_prio_t prio) {
+   taskList_item_t*  pendingTask;
+   uint8_t           count;
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   
+   pendingTask = scheduler_findPendingTask(cb,prio);
+   if (pendingTask!=NULL) {
+      // merge into the pending task
+      if (pendingTask->count<0xff) {
+         pendingTask->count++;
+      }
+      count = pendingTask->count;
+      scheduler_dbg.numCoalesced++;
+      ENABLE_INTERRUPTS();
+      return count;
+   }
    
-   // find an empty task container
-   taskContainer = &scheduler_vars.taskBuf[0];
-   while (taskContainer->cb!=NULL &&
-          taskContainer<=&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
-      taskContainer++;
+   // no such task pending, push a new one without re-enabling interrupts in
+   // between, so an interrupt can not push the same callback meanwhile
+   if (scheduler_insertTask(cb,prio)==E_SUCCESS) {
+      count = 1;
+   } else {
+      count = 0;
    }
-   if (taskContainer>&scheduler_vars.taskBuf[TASK_LIST_DEPTH-1]) {
-      // task list has overflown. This should never happpen!
    
-      // we can not print from within the kernel. Instead:
-      // blink the error LED
-      leds_error_blink();
-      // reset the board
-      board_reset();
+   ENABLE_INTERRUPTS();
+   return count;
+}
+
+/**
+\brief Trigger this module to print status information, over serial.
+
+debugPrint_* functions are used by the openserial module to continuously print
+status information about several modules in the OpenWSN stack.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_scheduler() {
+#ifdef SCHEDULER_PROFILE
+   debugSchedulerProfileEntry_t temp;
+   scheduler_profile_t*         row;
+   INTERRUPT_DECLARATION();
+   
+   scheduler_vars.debugPrintRow = (scheduler_vars.debugPrintRow+1)%SCHEDULER_PROFILE_NUM_CB;
+   row                          = &scheduler_dbg.profile[scheduler_vars.debugPrintRow];
+   
+   DISABLE_INTERRUPTS();
+   if (row->cb==NULL) {
+      ENABLE_INTERRUPTS();
+      return FALSE;
+   }
+   temp.row                     = scheduler_vars.debugPrintRow;
+   temp.cb                      = (uint32_t)(uintptr_t)row->cb;
+   temp.numRuns                 = row->numRuns;
+   temp.runMin                  = row->runMin;
+   temp.runMax                  = row->runMax;
+   temp.runAvg                  = (PORT_TIMER_WIDTH)(row->runSum/row->numRuns);
+   temp.waitMin                 = row->waitMin;
+   temp.waitMax                 = row->waitMax;
+   temp.waitAvg                 = (PORT_TIMER_WIDTH)(row->waitSum/row->numRuns);
+   ENABLE_INTERRUPTS();
+   
+   openserial_printStatus(STATUS_SCHEDULER,
+         (uint8_t*)&temp,
+         sizeof(debugSchedulerProfileEntry_t)
+   );
+   
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+//=========================== private =========================================
+
+/**
+\brief Retrieve the highest priority which has at least one pending task.
+
+\pre Called with interrupts disabled, and readyBitmap is not 0.
+
+\returns The priority of the FIFO to consume from.
+*/
+port_INLINE uint8_t scheduler_highestReadyPrio() {
+   uint8_t bitmap;
+   
+   bitmap = scheduler_vars.readyBitmap;
+   if (bitmap & 0xf0) {
+      return scheduler_clz4[bitmap>>4];
+   } else {
+      return 4+scheduler_clz4[bitmap&0x0f];
    }
+}
+
+/**
+\brief Append a task to the FIFO of its priority.
+
+\pre Called with interrupts disabled.
+
+\param[in] cb   The callback of the task.
+\param[in] prio The priority of the task.
+
+\returns E_SUCCESS if the task was pushed, E_FAIL if it was coalesced or
+         rejected because no task container was free.
+*/
+owerror_t scheduler_insertTask(task_cbt cb, task_prio_t prio) {
+   taskList_item_t*  taskContainer;
+   taskFifo_t*       fifo;
+   
+   if (scheduler_vars.freeList==NULL) {
+      // task list has overflown
+      scheduler_dbg.numOverflows++;
+      if (scheduler_handleOverflow(cb,prio)==FALSE) {
+         return E_FAIL;
+      }
+   }
+   
+   // take an empty task container from the free list
+   taskContainer                  = scheduler_vars.freeList;
+   scheduler_vars.freeList        = taskContainer->next;
+   
    // fill that task container with this task
    taskContainer->cb              = cb;
    taskContainer->prio            = prio;
+   taskContainer->count           = 1;
+#ifdef SCHEDULER_PROFILE
+   taskContainer->pushTime        = bsp_timer_get_currentValue();
+#endif
+   taskContainer->next            = NULL;
    
-   // find position in queue
-   taskListWalker                 = &scheduler_vars.task_list;
-   while (*taskListWalker!=NULL &&
-          (*taskListWalker)->prio < taskContainer->prio) {
-      taskListWalker              = (taskList_item_t**)&((*taskListWalker)->next);
+   // append at the tail of the FIFO of that priority
+   fifo                           = &scheduler_vars.fifo[prio];
+   if (fifo->tail==NULL) {
+      fifo->head                  = taskContainer;
+   } else {
+      fifo->tail->next            = taskContainer;
    }
-   // insert at that position
-   taskContainer->next            = *taskListWalker;
-   *taskListWalker                = taskContainer;
+   fifo->tail                     = taskContainer;
+   scheduler_vars.readyBitmap    |= (1<<(TASKPRIO_MAX-1-prio));
+   
    // maintain debug stats
    scheduler_dbg.numTasksCur++;
    if (scheduler_dbg.numTasksCur>scheduler_dbg.numTasksMax) {
       scheduler_dbg.numTasksMax   = scheduler_dbg.numTasksCur;
    }
    
-   ENABLE_INTERRUPTS();
+   return E_SUCCESS;
 }
 
-//=========================== private =========================================
+/**
+\brief Apply the #SCHEDULER_OVERFLOW_POLICY when no task container is free.
+
+\pre Called with interrupts disabled.
+
+\param[in] cb   The callback of the task being pushed.
+\param[in] prio The priority of the task being pushed.
+
+\returns TRUE if a task container was freed and the task can be pushed,
+         FALSE if the task was coalesced or rejected.
+*/
+bool scheduler_handleOverflow(task_cbt cb, task_prio_t prio) {
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_COALESCE
+   taskList_item_t* pendingTask;
+#endif
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_DROPLOWEST
+   taskList_item_t* victim;
+   taskFifo_t*      fifo;
+   uint8_t          lowestPrio;
+#endif
+   
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_RESET
+   // we can not print from within the kernel. Instead:
+   // blink the error LED
+   leds_error_blink();
+   // reset the board
+   board_reset();
+#endif
+   
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_COALESCE
+   // the new task is redundant if the same callback is still pending
+   pendingTask = scheduler_findPendingTask(cb,prio);
+   if (pendingTask!=NULL) {
+      if (pendingTask->count<0xff) {
+         pendingTask->count++;
+      }
+      scheduler_dbg.numCoalesced++;
+      return FALSE;
+   }
+#endif
+   
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_DROPLOWEST
+   // the lowest priority pending level is the lowest bit set in the bitmap
+   lowestPrio = TASKPRIO_MAX-1;
+   while (lowestPrio>prio &&
+          (scheduler_vars.readyBitmap & (1<<(TASKPRIO_MAX-1-lowestPrio)))==0) {
+      lowestPrio--;
+   }
+   if (lowestPrio>prio) {
+      // evict the oldest task of that level
+      fifo                        = &scheduler_vars.fifo[lowestPrio];
+      victim                      = fifo->head;
+      fifo->head                  = victim->next;
+      if (fifo->head==NULL) {
+         fifo->tail               = NULL;
+         scheduler_vars.readyBitmap &= ~(1<<(TASKPRIO_MAX-1-lowestPrio));
+      }
+      victim->cb                  = NULL;
+      victim->prio                = TASKPRIO_NONE;
+      victim->count               = 0;
+      victim->next                = scheduler_vars.freeList;
+      scheduler_vars.freeList     = victim;
+      scheduler_dbg.numTasksCur--;
+      scheduler_dbg.numDropped++;
+      return TRUE;
+   }
+#endif
+   
+   // discard the new task
+   scheduler_dbg.numRejected++;
+   return FALSE;
+}
+
+/**
+\brief Find a pending task with the given callback and priority.
+
+\pre Called with interrupts disabled.
+
+\param[in] cb   The callback to look for.
+\param[in] prio The priority of the FIFO to look into.
+
+\returns A pointer to the pending task, or NULL if there is none.
+*/
+taskList_item_t* scheduler_findPendingTask(task_cbt cb, task_prio_t prio) {
+   taskList_item_t* taskWalker;
+   
+   taskWalker = scheduler_vars.fifo[prio].head;
+   while (taskWalker!=NULL) {
+      if (taskWalker->cb==cb) {
+         return taskWalker;
+      }
+      taskWalker = taskWalker->next;
+   }
+   return NULL;
+}
+
+#ifdef SCHEDULER_PROFILE
+/**
+\brief Record the run time and queueing delay of a task which just ran.
+
+\param[in] task      The task which just ran.
+\param[in] startTime The bsp_timer value right before the callback was called.
+\param[in] endTime   The bsp_timer value right after the callback returned.
+*/
+void scheduler_profileTask(taskList_item_t* task,
+                           PORT_TIMER_WIDTH startTime,
+                           PORT_TIMER_WIDTH endTime) {
+   scheduler_profile_t* row;
+   PORT_TIMER_WIDTH     runTime;
+   PORT_TIMER_WIDTH     waitTime;
+   uint8_t              i;
+   INTERRUPT_DECLARATION();
+   
+   runTime  = endTime-startTime;
+   waitTime = startTime-task->pushTime;
+   
+   DISABLE_INTERRUPTS();
+   
+   // find the row of this callback, or a free one
+   row = NULL;
+   for (i=0;i<SCHEDULER_PROFILE_NUM_CB;i++) {
+      if (scheduler_dbg.profile[i].cb==task->cb) {
+         row = &scheduler_dbg.profile[i];
+         break;
+      }
+      if (row==NULL && scheduler_dbg.profile[i].cb==NULL) {
+         row = &scheduler_dbg.profile[i];
+      }
+   }
+   if (row==NULL) {
+      scheduler_dbg.numUnprofiled++;
+      ENABLE_INTERRUPTS();
+      return;
+   }
+   
+   if (row->cb==NULL || row->numRuns==0xffff) {
+      // first run, or restart the statistics before they overflow
+      row->cb       = task->cb;
+      row->numRuns  = 0;
+      row->runMin   = runTime;
+      row->runMax   = runTime;
+      row->runSum   = 0;
+      row->waitMin  = waitTime;
+      row->waitMax  = waitTime;
+      row->waitSum  = 0;
+   }
+   
+   row->numRuns++;
+   if (runTime<row->runMin) {
+      row->runMin   = runTime;
+   }
+   if (runTime>row->runMax) {
+      row->runMax   = runTime;
+   }
+   row->runSum     += runTime;
+   if (waitTime<row->waitMin) {
+      row->waitMin  = waitTime;
+   }
+   if (waitTime>row->waitMax) {
+      row->waitMax  = waitTime;
+   }
+   row->waitSum    += waitTime;
+   
+   ENABLE_INTERRUPTS();
+}
+#endif
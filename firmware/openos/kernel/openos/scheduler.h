@@ -29,6 +29,43 @@ typedef enum {
 
 #define TASK_LIST_DEPTH      10
 
+/**
+\brief What to do when a task is pushed while all task containers are in use.
+
+- #SCHEDULER_OVERFLOW_RESET blinks the error LED and resets the board.
+- #SCHEDULER_OVERFLOW_FAIL discards the new task and returns #E_FAIL to the
+  caller.
+- #SCHEDULER_OVERFLOW_COALESCE discards the new task if the same callback is
+  already pending at the same priority, otherwise behaves as
+  #SCHEDULER_OVERFLOW_FAIL.
+- #SCHEDULER_OVERFLOW_DROPLOWEST evicts the oldest pending task of the lowest
+  priority level to make room for the new task, if that level has a lower
+  priority than the new task, otherwise behaves as #SCHEDULER_OVERFLOW_FAIL.
+*/
+#define SCHEDULER_OVERFLOW_RESET       0
+#define SCHEDULER_OVERFLOW_FAIL        1
+#define SCHEDULER_OVERFLOW_COALESCE    2
+#define SCHEDULER_OVERFLOW_DROPLOWEST  3
+
+#ifndef SCHEDULER_OVERFLOW_POLICY
+#define SCHEDULER_OVERFLOW_POLICY      SCHEDULER_OVERFLOW_COALESCE
+#endif
+
+/**
+\brief Uncomment to profile the execution of tasks.
+
+When defined, the scheduler timestamps each task with the bsp_timer when it is
+pushed and when it is executed, and keeps the run time and queueing delay
+statistics of up to #SCHEDULER_PROFILE_NUM_CB different callbacks. These are
+printed over serial as #STATUS_SCHEDULER.
+
+\note Durations are measured in bsp_timer ticks. A measurement is wrong if the
+   bsp_timer is reset while the task is pending or running.
+*/
+//#define SCHEDULER_PROFILE
+
+#define SCHEDULER_PROFILE_NUM_CB       8
+
 //=========================== typedef =========================================
 
 typedef void (*task_cbt)();
@@ -36,21 +73,75 @@ typedef void (*task_cbt)();
 typedef struct task_llist_t {
    task_cbt             cb;
    task_prio_t          prio;
+   uint8_t              count;                   // number of pushes merged into this task
+#ifdef SCHEDULER_PROFILE
+   PORT_TIMER_WIDTH     pushTime;                // bsp_timer value when pushed
+#endif
    void*                next;
 } taskList_item_t;
 
+/**
+\brief FIFO of the tasks pending at one priority level.
+
+Tasks are appended at the tail and consumed from the head, so tasks of the
+same priority are executed in the order they were pushed.
+*/
+typedef struct {
+   taskList_item_t*     head;
+   taskList_item_t*     tail;
+} taskFifo_t;
+
+#ifdef SCHEDULER_PROFILE
+typedef struct {
+   task_cbt             cb;                      // NULL if row unused
+   uint16_t             numRuns;
+   PORT_TIMER_WIDTH     runMin;                  // execution time, in ticks
+   PORT_TIMER_WIDTH     runMax;
+   uint32_t             runSum;
+   PORT_TIMER_WIDTH     waitMin;                 // push to execution delay, in ticks
+   PORT_TIMER_WIDTH     waitMax;
+   uint32_t             waitSum;
+} scheduler_profile_t;
+#endif
+
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t              row;
+   uint32_t             cb;
+   uint16_t             numRuns;
+   PORT_TIMER_WIDTH     runMin;
+   PORT_TIMER_WIDTH     runMax;
+   PORT_TIMER_WIDTH     runAvg;
+   PORT_TIMER_WIDTH     waitMin;
+   PORT_TIMER_WIDTH     waitMax;
+   PORT_TIMER_WIDTH     waitAvg;
+} debugSchedulerProfileEntry_t;
+PRAGMA(pack());
+
 //=========================== module variables ================================
 
 typedef struct {
    taskList_item_t      taskBuf[TASK_LIST_DEPTH];
-   taskList_item_t*     task_list;
-   uint8_t              numTasksCur;
-   uint8_t              numTasksMax;
+   taskList_item_t*     freeList;                // unused task containers
+   taskFifo_t           fifo[TASKPRIO_MAX];      // one FIFO per priority
+   uint8_t              readyBitmap;             // bit (TASKPRIO_MAX-1-prio) set if fifo[prio] not empty
+#ifdef SCHEDULER_PROFILE
+   uint8_t              debugPrintRow;
+#endif
 } scheduler_vars_t;
 
 typedef struct {
    uint8_t              numTasksCur;
    uint8_t              numTasksMax;
+   // overflow statistics
+   uint16_t             numOverflows;            // pushes while no free container
+   uint16_t             numCoalesced;            // new task merged into a pending one
+   uint16_t             numDropped;              // pending task evicted for a new one
+   uint16_t             numRejected;             // new task discarded, E_FAIL returned
+#ifdef SCHEDULER_PROFILE
+   scheduler_profile_t  profile[SCHEDULER_PROFILE_NUM_CB];
+   uint16_t             numUnprofiled;           // runs of callbacks not fitting in profile[]
+#endif
 } scheduler_dbg_t;
 
 //=========================== prototypes ======================================
@@ -58,7 +149,9 @@ typedef struct {
 // public functions
 void scheduler_init();
 void scheduler_start();
-void scheduler_push_task(task_cbt task_cb, task_prio_t prio);
+owerror_t scheduler_push_task(task_cbt task_cb, task_prio_t prio);
+uint8_t scheduler_push_task_unique(task_cbt task_cb, task_prio_t prio);
+bool    debugPrint_scheduler();
 
 // interrupt handlers
 void isr_ieee154e_newSlot();
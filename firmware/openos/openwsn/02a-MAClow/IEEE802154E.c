@@ -20,6 +20,11 @@ ieee154e_vars_t    ieee154e_vars;
 ieee154e_stats_t   ieee154e_stats;
 ieee154e_dbg_t     ieee154e_dbg;
 
+// default 16-channel hopping sequence of IEEE802.15.4e, as offsets from channel 11
+static const uint8_t ieee154e_defaultHoppingSequence[NUM_CHANNELS] = {
+   5, 6, 12, 7, 15, 4, 14, 11, 8, 0, 1, 2, 13, 3, 9, 10
+};
+
 //=========================== prototypes ======================================
 
 // SYNCHRONIZING
@@ -65,9 +70,13 @@ bool     isValidAck(ieee802154_header_iht*     ieee802514_header,
 // ASN handling
 void     incrementAsnOffset();
 void     asnStoreFromAdv(OpenQueueEntry_t* advFrame);
+void     blacklistStoreFromAdv(OpenQueueEntry_t* advFrame);
 // synchronization
-void     synchronizePacket(PORT_TIMER_WIDTH timeReceived);
-void     synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection);
+void     synchronizePacket(PORT_TIMER_WIDTH timeReceived, open_addr_t* timeSource);
+void     synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection, open_addr_t* timeSource);
+void     updateDrift(open_addr_t* timeSource, PORT_SIGNED_INT_WIDTH offset);
+uint16_t getDriftUncertaintyPpm();
+PORT_TIMER_WIDTH calculateRxGuardTime(asn_t* asn);
 void     changeIsSync(bool newIsSync);
 // notifying upper layer
 void     notif_sendDone(OpenQueueEntry_t* packetSent, owerror_t error);
@@ -75,8 +84,14 @@ void     notif_receive(OpenQueueEntry_t* packetReceived);
 // statistics
 void     resetStats();
 void     updateStats(PORT_SIGNED_INT_WIDTH timeCorrection);
+void     recordChannelTx(bool acked);
+void     recordChannelRx(bool crcValid);
+void     updateChannelBlacklist();
 // misc
-uint8_t  calculateFrequency(uint8_t channelOffset);
+uint8_t  calculateFrequency(uint8_t asnOffset, uint8_t channelOffset);
+void     prepareSlot(bool nextSlot);
+void     prepareSlot_getPacket();
+void     traceRecord(uint8_t event);
 void     changeState(ieee154e_state_t newstate);
 void     endSlot();
 bool     debugPrint_asn();
@@ -91,6 +106,7 @@ Call this function once before any other function in this module, possibly
 during boot-up.
 */
 void ieee154e_init() {
+   uint8_t i;
    
    // initialize variables
    memset(&ieee154e_vars,0,sizeof(ieee154e_vars_t));
@@ -105,6 +121,15 @@ void ieee154e_init() {
    resetStats();
    ieee154e_stats.numDeSync                 = 0;
    
+   // no clock drift known yet
+   for (i=0;i<NUMTIMESOURCES;i++) {
+      ieee154e_vars.drift[i].address.type   = ADDR_NONE;
+   }
+   ieee154e_vars.rxGuardTime                = TsLongGT;
+   
+   // build the hopping sequence
+   ieee154e_setChannelBlacklist(CHANNEL_BLACKLIST);
+   
    // switch radio on
    radio_rfOn();
    
@@ -150,6 +175,125 @@ PORT_TIMER_WIDTH ieee154e_asnDiff(asn_t* someASN) {
    return diff;
 }
 
+/**
+\brief Copy the current ASN.
+
+\param asn [out] where to copy the current ASN to
+*/
+void ieee154e_getAsnStruct(asn_t* asn) {
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   memcpy(asn,&ieee154e_vars.asn,sizeof(asn_t));
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief Set which channels are not used for channel hopping.
+
+The hopping sequence keeps NUM_CHANNELS entries, so the channel of a slot only
+depends on its ASN and channel offset. Each blacklisted channel in the default
+hopping sequence is replaced by one of the allowed channels, taken in turn.
+All motes in the network need to use the same blacklist.
+
+#SYNCHRONIZING_CHANNEL is never blacklisted, since joining motes listen on it
+for ADVs.
+
+\param blacklist [in] bit (channel-11) set to not use that channel
+*/
+void ieee154e_setChannelBlacklist(uint16_t blacklist) {
+   uint8_t allowed[NUM_CHANNELS];
+   uint8_t numAllowed;
+   uint8_t i;
+   uint8_t j;
+   INTERRUPT_DECLARATION();
+   
+   blacklist &= ~(1<<(SYNCHRONIZING_CHANNEL-11));
+   
+   // list the allowed channels, in the order of the default hopping sequence
+   numAllowed = 0;
+   for (i=0;i<NUM_CHANNELS;i++) {
+      if ((blacklist & (1<<ieee154e_defaultHoppingSequence[i]))==0) {
+         allowed[numAllowed++] = ieee154e_defaultHoppingSequence[i];
+      }
+   }
+   
+   DISABLE_INTERRUPTS();
+   ieee154e_vars.channelBlacklist = blacklist;
+   j = 0;
+   for (i=0;i<NUM_CHANNELS;i++) {
+      if ((blacklist & (1<<ieee154e_defaultHoppingSequence[i]))==0) {
+         ieee154e_vars.hoppingSequence[i] = 11+ieee154e_defaultHoppingSequence[i];
+      } else {
+         ieee154e_vars.hoppingSequence[i] = 11+allowed[j];
+         j = (j+1)%numAllowed;
+      }
+   }
+   ENABLE_INTERRUPTS();
+}
+
+/**
+\brief How long the upper layer can wait before sending a KA to its time source.
+
+The KA is due when the drift accumulated since the last resynchronization
+reaches #KATIMEOUT_GUARD, once the drift of the time source is known.
+
+\returns The KA timeout, in slots.
+*/
+uint16_t ieee154e_getKaTimeout() {
+   uint16_t uncertainty;
+   uint32_t kaTimeout;
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   uncertainty = getDriftUncertaintyPpm();
+   ENABLE_INTERRUPTS();
+   
+   if (uncertainty==0) {
+      return KATIMEOUT;
+   }
+   kaTimeout = ((uint32_t)KATIMEOUT_GUARD*1000000)/((uint32_t)uncertainty*TsSlotDuration);
+   if (kaTimeout<KATIMEOUT_MIN) {
+      kaTimeout = KATIMEOUT_MIN;
+   }
+   if (kaTimeout>KATIMEOUT_MAX) {
+      kaTimeout = KATIMEOUT_MAX;
+   }
+   return (uint16_t)kaTimeout;
+}
+
+/**
+\brief Stop recording the timing trace until it is printed.
+
+Called when the MAC logs an error, so the trace shows what led to it. Does
+nothing unless #IEEE802154E_TRACE_LENGTH is defined.
+*/
+void ieee154e_freezeTrace() {
+#ifdef IEEE802154E_TRACE_LENGTH
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   ieee154e_vars.traceFrozen = TRUE;
+   ENABLE_INTERRUPTS();
+#endif
+}
+
+/**
+\brief Drop a packet from the prepared next slot, as it is being freed.
+
+The entry can be reallocated and handed to the MAC again before the slot
+starts, possibly to another neighbor. The slot then picks its packet again.
+
+Called by openqueue, with interrupts disabled.
+
+\param pkt [in] The packet being freed.
+*/
+void ieee154e_forgetPacket(OpenQueueEntry_t* pkt) {
+   if (ieee154e_vars.nextSlot.dataToSend==pkt) {
+      ieee154e_vars.nextSlot.dataToSend = NULL;
+      // another packet may be waiting for that cell, look again
+      ieee154e_vars.nextSlot.txGeneration--;
+   }
+}
+
 //======= events
 
 /**
@@ -158,6 +302,7 @@ PORT_TIMER_WIDTH ieee154e_asnDiff(asn_t* someASN) {
 This function executes in ISR mode, when the new slot timer fires.
 */
 void isr_ieee154e_newSlot() {
+   traceRecord(TRACE_ISR_ENTER|TRACE_ISR_NEWSLOT);
    radio_setTimerPeriod(TsSlotDuration);
    if (ieee154e_vars.isSync==FALSE) {
       if (idmanager_getIsDAGroot()==TRUE) {
@@ -169,6 +314,7 @@ void isr_ieee154e_newSlot() {
       activity_ti1ORri1();
    }
    ieee154e_dbg.num_newSlot++;
+   traceRecord(TRACE_ISR_EXIT|TRACE_ISR_NEWSLOT);
 }
 
 /**
@@ -177,6 +323,7 @@ void isr_ieee154e_newSlot() {
 This function executes in ISR mode, when the FSM timer fires.
 */
 void isr_ieee154e_timer() {
+   traceRecord(TRACE_ISR_ENTER|TRACE_ISR_TIMER);
    switch (ieee154e_vars.state) {
       case S_TXDATAOFFSET:
          activity_ti2();
@@ -248,6 +395,7 @@ void isr_ieee154e_timer() {
          break;
    }
    ieee154e_dbg.num_timer++;
+   traceRecord(TRACE_ISR_EXIT|TRACE_ISR_TIMER);
 }
 
 /**
@@ -256,6 +404,7 @@ void isr_ieee154e_timer() {
 This function executes in ISR mode.
 */
 void ieee154e_startOfFrame(PORT_TIMER_WIDTH capturedTime) {
+   traceRecord(TRACE_ISR_ENTER|TRACE_ISR_STARTOFFRAME);
    if (ieee154e_vars.isSync==FALSE) {
      activity_synchronize_startOfFrame(capturedTime);
    } else {
@@ -296,6 +445,7 @@ void ieee154e_startOfFrame(PORT_TIMER_WIDTH capturedTime) {
       }
    }
    ieee154e_dbg.num_startOfFrame++;
+   traceRecord(TRACE_ISR_EXIT|TRACE_ISR_STARTOFFRAME);
 }
 
 /**
@@ -304,6 +454,7 @@ void ieee154e_startOfFrame(PORT_TIMER_WIDTH capturedTime) {
 This function executes in ISR mode.
 */
 void ieee154e_endOfFrame(PORT_TIMER_WIDTH capturedTime) {
+   traceRecord(TRACE_ISR_ENTER|TRACE_ISR_ENDOFFRAME);
    if (ieee154e_vars.isSync==FALSE) {
       activity_synchronize_endOfFrame(capturedTime);
    } else {
@@ -331,6 +482,7 @@ void ieee154e_endOfFrame(PORT_TIMER_WIDTH capturedTime) {
       }
    }
    ieee154e_dbg.num_endOfFrame++;
+   traceRecord(TRACE_ISR_EXIT|TRACE_ISR_ENDOFFRAME);
 }
 
 //======= misc
@@ -386,6 +538,89 @@ bool debugPrint_macStats() {
    return TRUE;
 }
 
+/**
+\brief Trigger this module to print status information, over serial.
+
+debugPrint_* functions are used by the openserial module to continuously print
+status information about several modules in the OpenWSN stack.
+
+Prints the channel blacklist (2B, little endian), followed by the link
+statistics of each channel.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_channelStats() {
+   uint8_t output[2+sizeof(ieee154e_vars.channelStats)];
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   output[0] = (uint8_t)(ieee154e_vars.channelBlacklist & 0x00ff);
+   output[1] = (uint8_t)(ieee154e_vars.channelBlacklist >> 8);
+   memcpy(&output[2],ieee154e_vars.channelStats,sizeof(ieee154e_vars.channelStats));
+   ENABLE_INTERRUPTS();
+   
+   openserial_printStatus(STATUS_CHANNELSTATS,output,sizeof(output));
+   return TRUE;
+}
+
+/**
+\brief Trigger this module to print status information, over serial.
+
+debugPrint_* functions are used by the openserial module to continuously print
+status information about several modules in the OpenWSN stack.
+
+Prints the index of the first event printed (2B, little endian), followed by
+up to #IEEE802154E_TRACE_PRINTMAX ieee154e_traceEntry_t not printed yet. A gap
+in the index means events were overwritten before they could be printed. Once
+all events are printed, a frozen trace starts recording again.
+
+\returns TRUE if this function printed something, FALSE otherwise.
+*/
+bool debugPrint_trace() {
+#ifdef IEEE802154E_TRACE_LENGTH
+   uint8_t  output[2+IEEE802154E_TRACE_PRINTMAX*sizeof(ieee154e_traceEntry_t)];
+   uint8_t  numEntries;
+   uint8_t  i;
+   uint16_t first;
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   if ((uint16_t)(ieee154e_vars.traceNumWritten-ieee154e_vars.traceNumPrinted)>IEEE802154E_TRACE_LENGTH) {
+      // the oldest events were overwritten
+      ieee154e_vars.traceNumPrinted = ieee154e_vars.traceNumWritten-IEEE802154E_TRACE_LENGTH;
+   }
+   first      = ieee154e_vars.traceNumPrinted;
+   numEntries = 0;
+   while (
+         numEntries<IEEE802154E_TRACE_PRINTMAX &&
+         ieee154e_vars.traceNumPrinted!=ieee154e_vars.traceNumWritten
+      ) {
+      memcpy(
+         &output[2+numEntries*sizeof(ieee154e_traceEntry_t)],
+         &ieee154e_vars.trace[ieee154e_vars.traceNumPrinted & (IEEE802154E_TRACE_LENGTH-1)],
+         sizeof(ieee154e_traceEntry_t)
+      );
+      ieee154e_vars.traceNumPrinted++;
+      numEntries++;
+   }
+   if (ieee154e_vars.traceNumPrinted==ieee154e_vars.traceNumWritten) {
+      ieee154e_vars.traceFrozen = FALSE;
+   }
+   ENABLE_INTERRUPTS();
+   
+   if (numEntries==0) {
+      return FALSE;
+   }
+   output[0] = (uint8_t)(first & 0x00ff);
+   output[1] = (uint8_t)(first >> 8);
+   i = 2+numEntries*sizeof(ieee154e_traceEntry_t);
+   openserial_printStatus(STATUS_TRACE,output,i);
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
 //=========================== private =========================================
 
 //======= SYNCHRONIZING
@@ -500,7 +735,7 @@ port_INLINE void activity_synchronize_endOfFrame(PORT_TIMER_WIDTH capturedTime)
       ieee154e_vars.dataReceived->payload = &(ieee154e_vars.dataReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.dataReceived->payload,
                                    &ieee154e_vars.dataReceived->length,
-                             sizeof(ieee154e_vars.dataReceived->packet),
+                                   ieee154e_vars.dataReceived->packetLength-FIRST_FRAME_BYTE,
                                    &ieee154e_vars.dataReceived->l1_rssi,
                                    &ieee154e_vars.dataReceived->l1_lqi,
                                    &ieee154e_vars.dataReceived->l1_crc);
@@ -551,14 +786,15 @@ port_INLINE void activity_synchronize_endOfFrame(PORT_TIMER_WIDTH capturedTime)
       //compute radio duty cycle
       ieee154e_vars.radioOnTics+=(radio_getTimerValue()-ieee154e_vars.radioOnInit);
       
-      // record the ASN from the ADV payload
+      // record the ASN and channel blacklist from the ADV payload
       asnStoreFromAdv(ieee154e_vars.dataReceived);
+      blacklistStoreFromAdv(ieee154e_vars.dataReceived);
       
       // toss the ADV payload
       packetfunctions_tossHeader(ieee154e_vars.dataReceived,ADV_PAYLOAD_LENGTH);
       
       // synchronize (for the first time) to the sender's ADV
-      synchronizePacket(ieee154e_vars.syncCapturedTime);
+      synchronizePacket(ieee154e_vars.syncCapturedTime,&ieee154e_vars.dataReceived->l2_nextORpreviousHop);
       
       // declare synchronized
       changeIsSync(TRUE);
@@ -596,7 +832,6 @@ port_INLINE void activity_synchronize_endOfFrame(PORT_TIMER_WIDTH capturedTime)
 
 port_INLINE void activity_ti1ORri1() {
    cellType_t  cellType;
-   open_addr_t neighbor;
    uint8_t  i;
    
    // increment ASN (do this first so debug pins are in sync)
@@ -640,16 +875,20 @@ port_INLINE void activity_ti1ORri1() {
       return;
    }
    
-   if (ieee154e_vars.slotOffset==ieee154e_vars.nextActiveSlotOffset) {
-      // this is the next active slot
-      
-      // advance the schedule
-      schedule_advanceSlot();
-      
-      // find the next one
-      ieee154e_vars.nextActiveSlotOffset    = schedule_getNextActiveSlotOffset();
-   } else {
-      // this is NOT the next active slot, abort
+   // the slot is normally prepared at the end of the previous one, unless the
+   // ASN jumped since (e.g. resynchronization, serial slots)
+   if (
+         ieee154e_vars.nextSlot.prepared==FALSE ||
+         ieee154e_vars.nextSlot.asn0and1!=ieee154e_vars.asn.bytes0and1
+      ) {
+      prepareSlot(FALSE);
+      ieee154e_dbg.num_slotNotPrepared++;
+   }
+   ieee154e_vars.nextSlot.prepared = FALSE;
+   
+   cellType = ieee154e_vars.nextSlot.cellType;
+   if (cellType==CELLTYPE_OFF) {
+      // this is NOT an active slot, abort
       // stop using serial
       openserial_stop();
       // abort the slot
@@ -659,19 +898,37 @@ port_INLINE void activity_ti1ORri1() {
       return;
    }
    
-   // check the schedule to see what type of slot this is
-   cellType = schedule_getType();
+   // frequency and packet to send come from the slot descriptor
+   ieee154e_vars.freq = ieee154e_vars.nextSlot.freq;
+   ieee154e_vars.dataToSend = ieee154e_vars.nextSlot.dataToSend;
+   if (
+         ieee154e_vars.dataToSend!=NULL &&
+         ieee154e_vars.dataToSend->owner!=COMPONENT_RES_TO_IEEE802154E
+      ) {
+      // the packet was taken back since the slot was prepared, look again
+      ieee154e_vars.dataToSend = NULL;
+      ieee154e_vars.nextSlot.txGeneration--;
+   }
+   if (
+         ieee154e_vars.dataToSend==NULL &&
+         ieee154e_vars.nextSlot.txDeferred==FALSE &&
+         ieee154e_vars.nextSlot.txGeneration!=openqueue_macGetTxGeneration() &&
+         cellType!=CELLTYPE_RX
+      ) {
+      // a packet was queued since the slot was prepared
+      prepareSlot_getPacket();
+      ieee154e_vars.dataToSend = ieee154e_vars.nextSlot.dataToSend;
+   }
+   
    switch (cellType) {
       case CELLTYPE_ADV:
          // stop using serial
          openserial_stop();
-         // look for an ADV packet in the queue
-         ieee154e_vars.dataToSend = openqueue_macGetAdvPacket();
          if (ieee154e_vars.dataToSend==NULL) {   // I will be listening for an ADV
             // change state
             changeState(S_RXDATAOFFSET);
             // arm rt1
-            radiotimer_schedule(DURATION_rt1);
+            radiotimer_schedule(ieee154e_vars.nextSlot.firstTimeout);
          } else {                                // I will be sending an ADV
             // change state
             changeState(S_TXDATAOFFSET);
@@ -679,32 +936,39 @@ port_INLINE void activity_ti1ORri1() {
             ieee154e_vars.dataToSend->owner = COMPONENT_IEEE802154E;
             // fill in the ASN field of the ADV
             ieee154e_getAsn(ieee154e_vars.dataToSend->l2_payload);
+            // fill in the channel blacklist field of the ADV
+            ieee154e_vars.dataToSend->l2_payload[5] = (uint8_t)(ieee154e_vars.channelBlacklist & 0x00ff);
+            ieee154e_vars.dataToSend->l2_payload[6] = (uint8_t)(ieee154e_vars.channelBlacklist >> 8);
             // record that I attempt to transmit this packet
             ieee154e_vars.dataToSend->l2_numTxAttempts++;
             // arm tt1
-            radiotimer_schedule(DURATION_tt1);
+            radiotimer_schedule(ieee154e_vars.nextSlot.firstTimeout);
          }
          break;
       case CELLTYPE_TXRX:
       case CELLTYPE_TX:
          // stop using serial
          openserial_stop();
-         // check whether we can send
-         if (schedule_getOkToSend()) {
-            schedule_getNeighbor(&neighbor);
-            ieee154e_vars.dataToSend = openqueue_macGetDataPacket(&neighbor);
-         } else {
-            ieee154e_vars.dataToSend = NULL;
-         }
          if (ieee154e_vars.dataToSend!=NULL) {   // I have a packet to send
             // change state
             changeState(S_TXDATAOFFSET);
             // change owner
             ieee154e_vars.dataToSend->owner = COMPONENT_IEEE802154E;
+            // announce a burst if more packets are queued for that neighbor
+            // and I can send them in the next slot
+            if (
+                  packetfunctions_isBroadcastMulticast(&ieee154e_vars.dataToSend->l2_nextORpreviousHop)==FALSE &&
+                  schedule_isNextSlotActive()==FALSE &&
+                  openqueue_macGetDataPacket(&ieee154e_vars.dataToSend->l2_nextORpreviousHop)!=NULL
+               ) {
+               ieee154e_vars.dataToSend->payload[0] |=  (1<<IEEE154_FCF_FRAME_PENDING);
+            } else {
+               ieee154e_vars.dataToSend->payload[0] &= ~(1<<IEEE154_FCF_FRAME_PENDING);
+            }
             // record that I attempt to transmit this packet
             ieee154e_vars.dataToSend->l2_numTxAttempts++;
             // arm tt1
-            radiotimer_schedule(DURATION_tt1);
+            radiotimer_schedule(ieee154e_vars.nextSlot.firstTimeout);
          } else if (cellType==CELLTYPE_TX){
             // abort
             endSlot();
@@ -756,8 +1020,7 @@ port_INLINE void activity_ti2() {
    // change state
    changeState(S_TXDATAPREPARE);
    
-   // calculate the frequency to transmit on
-   ieee154e_vars.freq = calculateFrequency(schedule_getChannelOffset()); 
+   // the frequency was set at the start of the slot, from the slot descriptor
    
    // configure the radio for that frequency
    radio_setFrequency(ieee154e_vars.freq);
@@ -856,11 +1119,13 @@ port_INLINE void activity_ti5(PORT_TIMER_WIDTH capturedTime) {
    }
    
    if (listenForAck==TRUE) {
+      // record the attempt in the statistics of this channel
+      recordChannelTx(FALSE);
       // arm tt5
       radiotimer_schedule(DURATION_tt5);
    } else {
       // indicate succesful Tx to schedule to keep statistics
-      schedule_indicateTx(&ieee154e_vars.asn,TRUE);
+      schedule_indicateTx(&ieee154e_vars.asn,TRUE,&ieee154e_vars.dataToSend->l2_nextORpreviousHop);
       // indicate to upper later the packet was sent successfully
       notif_sendDone(ieee154e_vars.dataToSend,E_SUCCESS);
       // reset local variable
@@ -874,8 +1139,7 @@ port_INLINE void activity_ti6() {
    // change state
    changeState(S_RXACKPREPARE);
    
-   // calculate the frequency to transmit on
-   ieee154e_vars.freq = calculateFrequency(schedule_getChannelOffset()); 
+   // the frequency was set at the start of the slot, from the slot descriptor
    
    // configure the radio for that frequency
    radio_setFrequency(ieee154e_vars.freq);
@@ -915,7 +1179,7 @@ port_INLINE void activity_ti7() {
 
 port_INLINE void activity_tie5() {
    // indicate transmit failed to schedule to keep stats
-   schedule_indicateTx(&ieee154e_vars.asn,FALSE);
+   schedule_indicateTx(&ieee154e_vars.asn,FALSE,&ieee154e_vars.dataToSend->l2_nextORpreviousHop);
    
    // decrement transmits left counter
    ieee154e_vars.dataToSend->l2_retriesLeft--;
@@ -1005,7 +1269,7 @@ port_INLINE void activity_ti9(PORT_TIMER_WIDTH capturedTime) {
       ieee154e_vars.ackReceived->payload = &(ieee154e_vars.ackReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.ackReceived->payload,
                                    &ieee154e_vars.ackReceived->length,
-                             sizeof(ieee154e_vars.ackReceived->packet),
+                                   ieee154e_vars.ackReceived->packetLength-FIRST_FRAME_BYTE,
                                    &ieee154e_vars.ackReceived->l1_rssi,
                                    &ieee154e_vars.ackReceived->l1_lqi,
                                    &ieee154e_vars.ackReceived->l1_crc);
@@ -1060,11 +1324,23 @@ port_INLINE void activity_ti9(PORT_TIMER_WIDTH capturedTime) {
          timeCorrection  = (PORT_SIGNED_INT_WIDTH)((PORT_TIMER_WIDTH)byte1<<8 | (PORT_TIMER_WIDTH)byte0);
          timeCorrection /=  US_PER_TICK;
          timeCorrection  = -timeCorrection;
-         synchronizeAck(timeCorrection);
+         synchronizeAck(timeCorrection,&ieee154e_vars.ackReceived->l2_nextORpreviousHop);
+      }
+      
+      // record the ACK in the statistics of this channel
+      recordChannelTx(TRUE);
+      
+      // continue the burst in the next slot if the receiver accepted it
+      if (
+            ieee802514_header.framePending==1 &&
+            (ieee154e_vars.dataToSend->payload[0] & (1<<IEEE154_FCF_FRAME_PENDING))!=0
+         ) {
+         ieee154e_vars.burst = BURST_TX;
+         memcpy(&ieee154e_vars.burstNeighbor,&ieee154e_vars.dataToSend->l2_nextORpreviousHop,sizeof(open_addr_t));
       }
       
       // inform schedule of successful transmission
-      schedule_indicateTx(&ieee154e_vars.asn,TRUE);
+      schedule_indicateTx(&ieee154e_vars.asn,TRUE,&ieee154e_vars.dataToSend->l2_nextORpreviousHop);
       
       // inform upper layer
       notif_sendDone(ieee154e_vars.dataToSend,E_SUCCESS);
@@ -1089,8 +1365,7 @@ port_INLINE void activity_ri2() {
 	// change state
    changeState(S_RXDATAPREPARE);
    
-   // calculate the frequency to transmit on
-   ieee154e_vars.freq = calculateFrequency(schedule_getChannelOffset()); 
+   // the frequency was set at the start of the slot, from the slot descriptor
    
    // configure the radio for that frequency
    radio_setFrequency(ieee154e_vars.freq);
@@ -1204,7 +1479,7 @@ port_INLINE void activity_ri5(PORT_TIMER_WIDTH capturedTime) {
       ieee154e_vars.dataReceived->payload = &(ieee154e_vars.dataReceived->packet[FIRST_FRAME_BYTE]);
       radio_getReceivedFrame(       ieee154e_vars.dataReceived->payload,
                                    &ieee154e_vars.dataReceived->length,
-                             sizeof(ieee154e_vars.dataReceived->packet),
+                                   ieee154e_vars.dataReceived->packetLength-FIRST_FRAME_BYTE,
                                    &ieee154e_vars.dataReceived->l1_rssi,
                                    &ieee154e_vars.dataReceived->l1_lqi,
                                    &ieee154e_vars.dataReceived->l1_crc);
@@ -1221,6 +1496,9 @@ port_INLINE void activity_ri5(PORT_TIMER_WIDTH capturedTime) {
       // toss CRC (2 last bytes)
       packetfunctions_tossFooter(   ieee154e_vars.dataReceived, LENGTH_CRC);
       
+      // record the reception in the statistics of this channel
+      recordChannelRx(ieee154e_vars.dataReceived->l1_crc);
+      
       // if CRC doesn't check, stop
       if (ieee154e_vars.dataReceived->l1_crc==FALSE) {
          // jump to the error code below this do-while loop
@@ -1237,8 +1515,9 @@ port_INLINE void activity_ri5(PORT_TIMER_WIDTH capturedTime) {
       }
       
       // store header details in packet buffer
-      ieee154e_vars.dataReceived->l2_frameType = ieee802514_header.frameType;
-      ieee154e_vars.dataReceived->l2_dsn       = ieee802514_header.dsn;
+      ieee154e_vars.dataReceived->l2_frameType    = ieee802514_header.frameType;
+      ieee154e_vars.dataReceived->l2_dsn          = ieee802514_header.dsn;
+      ieee154e_vars.dataReceived->l2_framePending = ieee802514_header.framePending;
       memcpy(&(ieee154e_vars.dataReceived->l2_nextORpreviousHop),&(ieee802514_header.src),sizeof(open_addr_t));
       
       // toss the IEEE802.15.4 header
@@ -1248,6 +1527,10 @@ port_INLINE void activity_ri5(PORT_TIMER_WIDTH capturedTime) {
       if (isValidAdv(&ieee802514_header)==TRUE) {
          if (idmanager_getIsDAGroot()==FALSE) {
             asnStoreFromAdv(ieee154e_vars.dataReceived);
+            // follow my preferred parent's channel blacklist
+            if (neighbors_isPreferredParent(&(ieee154e_vars.dataReceived->l2_nextORpreviousHop))) {
+               blacklistStoreFromAdv(ieee154e_vars.dataReceived);
+            }
          }
          // toss the ADV payload
          packetfunctions_tossHeader(ieee154e_vars.dataReceived,ADV_PAYLOAD_LENGTH);
@@ -1269,7 +1552,7 @@ port_INLINE void activity_ri5(PORT_TIMER_WIDTH capturedTime) {
       } else {
          // synchronize to the received packet iif I'm not a DAGroot and this is my preferred parent
          if (idmanager_getIsDAGroot()==FALSE && neighbors_isPreferredParent(&(ieee154e_vars.dataReceived->l2_nextORpreviousHop))) {
-            synchronizePacket(ieee154e_vars.syncCapturedTime);
+            synchronizePacket(ieee154e_vars.syncCapturedTime,&ieee154e_vars.dataReceived->l2_nextORpreviousHop);
          }
          // indicate reception to upper layer (no ACK asked)
          notif_receive(ieee154e_vars.dataReceived);
@@ -1301,7 +1584,7 @@ port_INLINE void activity_ri6() {
    changeState(S_TXACKPREPARE);
    
    // get a buffer to put the ack to send in
-   ieee154e_vars.ackToSend = openqueue_getFreePacketBuffer(COMPONENT_IEEE802154E);
+   ieee154e_vars.ackToSend = openqueue_getFreeSmallPacketBuffer(COMPONENT_IEEE802154E);
    if (ieee154e_vars.ackToSend==NULL) {
       // log the error
       openserial_printError(COMPONENT_IEEE802154E,ERR_NO_FREE_PACKET_BUFFER,
@@ -1340,11 +1623,20 @@ port_INLINE void activity_ri6() {
                             &(ieee154e_vars.dataReceived->l2_nextORpreviousHop)
                             );
    
+   // accept a burst if I can listen in the next slot (confirmed once the ACK is sent)
+   if (
+         ieee154e_vars.dataReceived->l2_framePending==TRUE &&
+         schedule_isNextSlotActive()==FALSE
+      ) {
+      ieee154e_vars.ackToSend->payload[0] |= (1<<IEEE154_FCF_FRAME_PENDING);
+      ieee154e_vars.burst = BURST_RX;
+      memcpy(&ieee154e_vars.burstNeighbor,&ieee154e_vars.dataReceived->l2_nextORpreviousHop,sizeof(open_addr_t));
+   }
+   
    // space for 2-byte CRC
    packetfunctions_reserveFooterSize(ieee154e_vars.ackToSend,2);
    
-    // calculate the frequency to transmit on
-   ieee154e_vars.freq = calculateFrequency(schedule_getChannelOffset()); 
+    // the frequency was set at the start of the slot, from the slot descriptor
    
    // configure the radio for that frequency
    radio_setFrequency(ieee154e_vars.freq);
@@ -1437,7 +1729,7 @@ port_INLINE void activity_ri9(PORT_TIMER_WIDTH capturedTime) {
    
    // synchronize to the received packet
    if (idmanager_getIsDAGroot()==FALSE && neighbors_isPreferredParent(&(ieee154e_vars.dataReceived->l2_nextORpreviousHop))) {
-      synchronizePacket(ieee154e_vars.syncCapturedTime);
+      synchronizePacket(ieee154e_vars.syncCapturedTime,&ieee154e_vars.dataReceived->l2_nextORpreviousHop);
    }
    
    // inform upper layer of reception (after ACK sent)
@@ -1545,7 +1837,7 @@ port_INLINE void incrementAsnOffset() {
    }
    // increment the offsets
    ieee154e_vars.slotOffset  = (ieee154e_vars.slotOffset+1)%schedule_getFrameLength();
-   ieee154e_vars.asnOffset   = (ieee154e_vars.asnOffset+1)%16;
+   ieee154e_vars.asnOffset   = (ieee154e_vars.asnOffset+1)%NUM_CHANNELS;
 }
 
 //from upper layer that want to send the ASN to compute timing or latency
@@ -1572,19 +1864,30 @@ port_INLINE void asnStoreFromAdv(OpenQueueEntry_t* advFrame) {
    the ADV is exchanged in slot 0, we know that we're currently at slotOffset==0
    */
    ieee154e_vars.slotOffset       = 0;
-   schedule_syncSlotOffset(ieee154e_vars.slotOffset);
-   ieee154e_vars.nextActiveSlotOffset = schedule_getNextActiveSlotOffset();
    
-   /* 
-   infer the asnOffset based on the fact that
-   ieee154e_vars.freq = 11 + (asnOffset + channelOffset)%16 
-   */
-   ieee154e_vars.asnOffset = ieee154e_vars.freq - 11 - schedule_getChannelOffset();
+   // align all slotframes of the schedule on the ASN
+   schedule_syncAsn(&ieee154e_vars.asn);
+   
+   // asnOffset=ASN%NUM_CHANNELS, computed 16 bits at a time
+   ieee154e_vars.asnOffset        = ieee154e_vars.asn.byte4%NUM_CHANNELS;
+   ieee154e_vars.asnOffset        = (((uint32_t)ieee154e_vars.asnOffset<<16)+ieee154e_vars.asn.bytes2and3)%NUM_CHANNELS;
+   ieee154e_vars.asnOffset        = (((uint32_t)ieee154e_vars.asnOffset<<16)+ieee154e_vars.asn.bytes0and1)%NUM_CHANNELS;
+}
+
+port_INLINE void blacklistStoreFromAdv(OpenQueueEntry_t* advFrame) {
+   uint16_t blacklist;
+   
+   blacklist = advFrame->payload[5]+256*advFrame->payload[6];
+   
+   // only rebuild the hopping sequence when the blacklist changes
+   if (blacklist!=ieee154e_vars.channelBlacklist) {
+      ieee154e_setChannelBlacklist(blacklist);
+   }
 }
 
 //======= synchronization
 
-void synchronizePacket(PORT_TIMER_WIDTH timeReceived) {
+void synchronizePacket(PORT_TIMER_WIDTH timeReceived, open_addr_t* timeSource) {
    PORT_SIGNED_INT_WIDTH  timeCorrection;
    PORT_TIMER_WIDTH newPeriod;
    PORT_TIMER_WIDTH currentValue;
@@ -1618,12 +1921,14 @@ void synchronizePacket(PORT_TIMER_WIDTH timeReceived) {
                             (errorparameter_t)timeCorrection,
                             (errorparameter_t)0);
    }
+   // learn the clock drift of the time source (it is late when timeCorrection>0)
+   updateDrift(timeSource,timeCorrection);
    // update the stats
    ieee154e_stats.numSyncPkt++;
    updateStats(timeCorrection);
 }
 
-void synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection) {
+void synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection, open_addr_t* timeSource) {
    PORT_TIMER_WIDTH newPeriod;
    PORT_TIMER_WIDTH currentPeriod;
    // calculate new period
@@ -1645,11 +1950,146 @@ void synchronizeAck(PORT_SIGNED_INT_WIDTH timeCorrection) {
                             (errorparameter_t)timeCorrection,
                             (errorparameter_t)1);
    }
+   // learn the clock drift of the time source (it is late when timeCorrection<0)
+   updateDrift(timeSource,-timeCorrection);
    // update the stats
    ieee154e_stats.numSyncAck++;
    updateStats(timeCorrection);
 }
 
+/**
+\brief Learn the clock drift of a time source from a time correction.
+
+Each correction, divided by the time since the previous one, is a sample of the
+drift of the time source relative to my clock. Samples taken too soon after the
+previous correction are dominated by the timer resolution and are not used,
+neither are implausibly large samples. The estimate and its mean deviation are moving
+averages of the samples.
+
+\param [in] timeSource The neighbor I just resynchronized to.
+\param [in] offset    In 32kHz ticks, how late its clock was compared to mine.
+*/
+void updateDrift(open_addr_t* timeSource, PORT_SIGNED_INT_WIDTH offset) {
+   ieee154e_drift_t* drift;
+   PORT_TIMER_WIDTH  elapsed;
+   PORT_TIMER_WIDTH  oldest;
+   int32_t           sample;
+   int32_t           error;
+   uint8_t           i;
+   
+   // find the time source, or replace the one I haven't synchronized to for longest
+   drift  = NULL;
+   oldest = 0;
+   for (i=0;i<NUMTIMESOURCES;i++) {
+      if (packetfunctions_sameAddress(timeSource,&ieee154e_vars.drift[i].address)==TRUE) {
+         drift = &ieee154e_vars.drift[i];
+         break;
+      }
+   }
+   if (drift==NULL) {
+      for (i=0;i<NUMTIMESOURCES;i++) {
+         if (ieee154e_vars.drift[i].address.type==ADDR_NONE) {
+            drift = &ieee154e_vars.drift[i];
+            break;
+         }
+         elapsed = ieee154e_asnDiff(&ieee154e_vars.drift[i].lastSyncAsn);
+         if (drift==NULL || elapsed>=oldest) {
+            drift  = &ieee154e_vars.drift[i];
+            oldest = elapsed;
+         }
+      }
+      memset(drift,0,sizeof(ieee154e_drift_t));
+      memcpy(&drift->address,timeSource,sizeof(open_addr_t));
+      memcpy(&drift->lastSyncAsn,&ieee154e_vars.asn,sizeof(asn_t));
+   }
+   ieee154e_vars.timeSource = drift-ieee154e_vars.drift;
+   
+   // take a sample of the drift, in ppm
+   elapsed = ieee154e_asnDiff(&drift->lastSyncAsn);
+   memcpy(&drift->lastSyncAsn,&ieee154e_vars.asn,sizeof(asn_t));
+   if (elapsed<DRIFT_MINSLOTS || elapsed>DESYNCTIMEOUT) {
+      return;
+   }
+   sample = ((int32_t)offset*1000000)/((int32_t)elapsed*TsSlotDuration);
+   if (sample<-DRIFT_MAXPPM || sample>DRIFT_MAXPPM) {
+      return;
+   }
+   
+   // update the estimate
+   if (drift->numSamples==0) {
+      drift->driftPpm    = (int16_t)sample;
+      drift->driftDevPpm = (uint16_t)(sample<0 ? -sample : sample);
+   } else {
+      error              = sample-drift->driftPpm;
+      drift->driftPpm   += (int16_t)(error/4);
+      if (error<0) {
+         error           = -error;
+      }
+      drift->driftDevPpm = (uint16_t)(((int32_t)drift->driftDevPpm*3+error)/4);
+   }
+   if (drift->numSamples<0xff) {
+      drift->numSamples++;
+   }
+}
+
+/**
+\brief How fast my clock may be drifting from my current time source.
+
+\returns The drift estimate plus twice its mean deviation, in ppm, or 0 if the
+   drift of my time source is not known yet.
+*/
+uint16_t getDriftUncertaintyPpm() {
+   ieee154e_drift_t* drift;
+   
+   drift = &ieee154e_vars.drift[ieee154e_vars.timeSource];
+   if (
+         idmanager_getIsDAGroot()==TRUE ||
+         drift->address.type==ADDR_NONE ||
+         drift->numSamples<DRIFT_MINSAMPLES
+      ) {
+      return 0;
+   }
+   return (drift->driftPpm<0 ? -drift->driftPpm : drift->driftPpm)+2*drift->driftDevPpm;
+}
+
+/**
+\brief Calculate the guard time to receive data in the cell just selected.
+
+The guard time only needs to cover the drift accumulated since I last
+resynchronized, when the transmitter is my time source and its drift is known.
+Otherwise, the full TsLongGT is used.
+
+\param [in] asn The ASN of the slot.
+
+\returns The guard time, in 32kHz ticks.
+*/
+PORT_TIMER_WIDTH calculateRxGuardTime(asn_t* asn) {
+   ieee154e_drift_t* drift;
+   open_addr_t       neighbor;
+   uint16_t          uncertainty;
+   uint16_t          elapsed;
+   uint32_t          guardTime;
+   
+   uncertainty = getDriftUncertaintyPpm();
+   if (uncertainty==0) {
+      return TsLongGT;
+   }
+   drift = &ieee154e_vars.drift[ieee154e_vars.timeSource];
+   schedule_getNeighbor(&neighbor);
+   if (packetfunctions_sameAddress(&neighbor,&drift->address)==FALSE) {
+      return TsLongGT;
+   }
+   elapsed = asn->bytes0and1-drift->lastSyncAsn.bytes0and1;
+   if (elapsed>DESYNCTIMEOUT) {
+      return TsLongGT;
+   }
+   guardTime = GUARDTIME_MIN+((uint32_t)uncertainty*elapsed*TsSlotDuration+999999)/1000000;
+   if (guardTime>TsLongGT) {
+      guardTime = TsLongGT;
+   }
+   return (PORT_TIMER_WIDTH)guardTime;
+}
+
 void changeIsSync(bool newIsSync) {
    ieee154e_vars.isSync = newIsSync;
    
@@ -1667,6 +2107,9 @@ void changeIsSync(bool newIsSync) {
 void notif_sendDone(OpenQueueEntry_t* packetSent, owerror_t error) {
    // record the outcome of the trasmission attempt
    packetSent->l2_sendDoneError   = error;
+   // the packet is not waiting for the MAC anymore (this uses the ASN it was
+   // queued at, so do it before overwriting l2_asn)
+   openqueue_macRemoveTxPacket(packetSent);
    // record the current ASN
    memcpy(&packetSent->l2_asn,&ieee154e_vars.asn,sizeof(asn_t));
    // associate this packet with the virtual component
@@ -1714,6 +2157,128 @@ void updateStats(PORT_SIGNED_INT_WIDTH timeCorrection) {
    }
 }
 
+/**
+\brief Record an ACK-requesting transmission on the current channel.
+
+Call with acked==FALSE when the frame is sent, and again with acked==TRUE when
+its ACK is received. Both counters are halved when the first saturates, which
+keeps their ratio.
+
+\param [in] acked TRUE to record the ACK of the last transmission
+*/
+port_INLINE void recordChannelTx(bool acked) {
+   ieee154e_channelStats_t* stats;
+   
+   stats = &ieee154e_vars.channelStats[ieee154e_vars.freq-11];
+   if (acked==TRUE) {
+      stats->numTxAck++;
+      return;
+   }
+   if (stats->numTx==0xff) {
+      stats->numTx    /= 2;
+      stats->numTxAck /= 2;
+   }
+   stats->numTx++;
+}
+
+/**
+\brief Record a frame received on the current channel.
+
+\param [in] crcValid whether that frame passed the CRC check
+*/
+port_INLINE void recordChannelRx(bool crcValid) {
+   ieee154e_channelStats_t* stats;
+   
+   stats = &ieee154e_vars.channelStats[ieee154e_vars.freq-11];
+   if (stats->numRx==0xff || stats->numRxCrcFail==0xff) {
+      stats->numRx        /= 2;
+      stats->numRxCrcFail /= 2;
+   }
+   if (crcValid==TRUE) {
+      stats->numRx++;
+   } else {
+      stats->numRxCrcFail++;
+   }
+}
+
+/**
+\brief Re-evaluate the adaptive channel blacklist, every #BLACKLIST_PERIOD
+slots.
+
+The DAGroot blacklists a channel when too few of its transmissions on that
+channel are ACKed, or too many of its receptions fail the CRC. A blacklisted
+channel is used again after #BLACKLIST_HOLD evaluations; it gets blacklisted
+again if it is still bad. #CHANNEL_BLACKLIST is always blacklisted, and at most
+#BLACKLIST_MAXCHANNELS other channels are.
+
+Other motes do not decide: they follow the blacklist their preferred parent
+announces in its ADVs, so all motes end up on the root's hopping sequence.
+
+All motes halve their statistics at each evaluation, so recent outcomes
+weigh more.
+*/
+void updateChannelBlacklist() {
+   ieee154e_channelStats_t* stats;
+   uint16_t blacklist;
+   uint8_t  numHeld;
+   uint8_t  i;
+   
+   if (idmanager_getIsDAGroot()==TRUE) {
+      // release the channels whose hold time is over
+      numHeld = 0;
+      for (i=0;i<NUM_CHANNELS;i++) {
+         stats = &ieee154e_vars.channelStats[i];
+         if (stats->blacklistHold>0) {
+            stats->blacklistHold--;
+         }
+         if (stats->blacklistHold>0) {
+            numHeld++;
+         }
+      }
+      
+      // blacklist the channels which performed badly
+      blacklist = CHANNEL_BLACKLIST;
+      for (i=0;i<NUM_CHANNELS;i++) {
+         stats = &ieee154e_vars.channelStats[i];
+         if (
+               stats->blacklistHold==0                         &&
+               numHeld<BLACKLIST_MAXCHANNELS                   &&
+               i!=SYNCHRONIZING_CHANNEL-11                     &&
+               (
+                  (
+                     stats->numTx>=BLACKLIST_MINTX &&
+                     (uint16_t)stats->numTxAck*100<(uint16_t)stats->numTx*BLACKLIST_MINPDR
+                  ) ||
+                  (
+                     stats->numRx+stats->numRxCrcFail>=BLACKLIST_MINRX &&
+                     (uint16_t)stats->numRxCrcFail*100>((uint16_t)stats->numRx+stats->numRxCrcFail)*BLACKLIST_MAXCRCFAIL
+                  )
+               )
+            ) {
+            stats->blacklistHold = BLACKLIST_HOLD;
+            numHeld++;
+         }
+         if (stats->blacklistHold>0) {
+            blacklist |= 1<<i;
+         }
+      }
+      
+      // switch hopping sequence, announced in the next ADVs
+      if (blacklist!=ieee154e_vars.channelBlacklist) {
+         ieee154e_setChannelBlacklist(blacklist);
+      }
+   }
+   
+   // age the statistics
+   for (i=0;i<NUM_CHANNELS;i++) {
+      stats = &ieee154e_vars.channelStats[i];
+      stats->numTx        /= 2;
+      stats->numTxAck     /= 2;
+      stats->numRx        /= 2;
+      stats->numRxCrcFail /= 2;
+   }
+}
+
 //======= misc
 
 /**
@@ -1725,19 +2290,157 @@ channelOffset indicating in the schedule, and of the ASN of the
 slot. This ensures channel hopping, consecutive packets sent in the same slot
 in the schedule are done on a difference frequency channel.
 
-During development, you can force single channel operation by having this
-function return a constant channel number (between 11 and 26). This allows you
-to use a single-channel sniffer; but you can not schedule two links on two
-different channel offsets in the same slot.
+The channel is read from the hopping sequence, at index
+(ASN+channelOffset)%NUM_CHANNELS, see ieee154e_setChannelBlacklist().
+
+During development, you can force single channel operation by defining
+#SINGLE_CHANNEL.
 
 \param [in] channelOffset channel offset for the current slot
 
 \returns The calculated frequency channel, an integer between 11 and 26.
 */
-port_INLINE uint8_t calculateFrequency(uint8_t channelOffset) {
-   // comment the following line out to disable channel hopping
+port_INLINE uint8_t calculateFrequency(uint8_t asnOffset, uint8_t channelOffset) {
+#ifdef SINGLE_CHANNEL
    return SYNCHRONIZING_CHANNEL; // single channel
-   //return 11+(ieee154e_vars.asnOffset+channelOffset)%16; //channel hopping
+#else
+   return ieee154e_vars.hoppingSequence[(asnOffset+channelOffset)%NUM_CHANNELS];
+#endif
+}
+
+/**
+\brief Prepare the slot descriptor, so starting a slot only reads it.
+
+This looks up the cell (combining all slotframes), the frequency, the packet to
+send and the first timeout of a slot. It is called at the end of each slot for
+the next one, in the time the radio is idle, or at the start of a slot which
+was not prepared.
+
+\param [in] nextSlot TRUE to prepare the slot after the current one, FALSE to
+   prepare the current one.
+*/
+void prepareSlot(bool nextSlot) {
+   ieee154e_slotDesc_t* slot;
+   asn_t                asn;
+   uint8_t              asnOffset;
+   
+   slot = &ieee154e_vars.nextSlot;
+   
+   memcpy(&asn,&ieee154e_vars.asn,sizeof(asn_t));
+   asnOffset = ieee154e_vars.asnOffset;
+   if (nextSlot==TRUE) {
+      asn.bytes0and1++;
+      if (asn.bytes0and1==0) {
+         asn.bytes2and3++;
+         if (asn.bytes2and3==0) {
+            asn.byte4++;
+         }
+      }
+      asnOffset = (asnOffset+1)%NUM_CHANNELS;
+   }
+   
+   slot->prepared        = TRUE;
+   slot->asn0and1        = asn.bytes0and1;
+   slot->dataToSend      = NULL;
+   slot->txDeferred      = FALSE;
+   slot->burst           = FALSE;
+   
+   // advance the schedule, combining all slotframes
+   if (schedule_advanceSlot(&asn)==TRUE) {
+      slot->cellType     = schedule_getType();
+   } else if (nextSlot==TRUE && ieee154e_vars.burst!=BURST_NONE) {
+      // continue the burst in this idle slot, as if in the cell it started in
+      // (the schedule keeps pointing to that cell)
+      slot->burst        = TRUE;
+      if (ieee154e_vars.burst==BURST_TX) {
+         slot->cellType  = CELLTYPE_TX;
+      } else {
+         slot->cellType  = CELLTYPE_RX;
+      }
+      ieee154e_dbg.num_burstSlot++;
+   } else {
+      slot->cellType     = CELLTYPE_OFF;
+   }
+   // a burst only continues in the slot right after the exchange announcing it
+   ieee154e_vars.burst   = BURST_NONE;
+   if (slot->cellType==CELLTYPE_OFF) {
+      return;
+   }
+   slot->freq            = calculateFrequency(asnOffset,schedule_getChannelOffset());
+   
+   // the previous slot is over, its guard time can be replaced
+   ieee154e_vars.rxGuardTime = calculateRxGuardTime(&asn);
+   
+   prepareSlot_getPacket();
+}
+
+/**
+\brief Look for the packet to send in the cell of the slot descriptor.
+
+The backoff of shared cells is only consulted once per slot, so a packet it
+holds back is not looked for again at the start of the slot.
+*/
+void prepareSlot_getPacket() {
+   ieee154e_slotDesc_t* slot;
+   open_addr_t          neighbor;
+   
+   slot = &ieee154e_vars.nextSlot;
+   slot->txGeneration = openqueue_macGetTxGeneration();
+   
+   switch (slot->cellType) {
+      case CELLTYPE_ADV:
+         slot->dataToSend = openqueue_macGetAdvPacket();
+         break;
+      case CELLTYPE_TX:
+      case CELLTYPE_TXRX:
+         if (slot->burst==TRUE) {
+            // the next packet of the burst, the backoff does not apply
+            slot->dataToSend = openqueue_macGetDataPacket(&ieee154e_vars.burstNeighbor);
+            break;
+         }
+         schedule_getNeighbor(&neighbor);
+         slot->dataToSend = openqueue_macGetDataPacket(&neighbor);
+         // check whether we can send it
+         if (slot->dataToSend!=NULL &&
+             schedule_getOkToSend(&slot->dataToSend->l2_nextORpreviousHop)==FALSE) {
+            slot->dataToSend = NULL;
+            slot->txDeferred = TRUE;
+         }
+         break;
+      default:
+         break;
+   }
+   
+   // the first timeout is relative to the start of the slot
+   if (slot->dataToSend!=NULL) {
+      slot->firstTimeout = DURATION_tt1;
+   } else {
+      slot->firstTimeout = DURATION_rt1;
+   }
+}
+
+/**
+\brief Record an event in the timing trace.
+
+Does nothing unless #IEEE802154E_TRACE_LENGTH is defined. This function is only
+called from interrupt context, or with interrupts disabled.
+
+\param [in] event The new ieee154e_state_t, or TRACE_ISR_ENTER or
+   TRACE_ISR_EXIT OR'ed with the interrupt.
+*/
+port_INLINE void traceRecord(uint8_t event) {
+#ifdef IEEE802154E_TRACE_LENGTH
+   ieee154e_traceEntry_t* entry;
+   
+   if (ieee154e_vars.traceFrozen==TRUE) {
+      return;
+   }
+   entry = &ieee154e_vars.trace[ieee154e_vars.traceNumWritten & (IEEE802154E_TRACE_LENGTH-1)];
+   entry->asn0  = (uint8_t)(ieee154e_vars.asn.bytes0and1 & 0x00ff);
+   entry->event = event;
+   entry->time  = radio_getTimerValue();
+   ieee154e_vars.traceNumWritten++;
+#endif
 }
 
 /**
@@ -1751,6 +2454,8 @@ this function toggles the FSM debug pin.
 void changeState(ieee154e_state_t newstate) {
    // update the state
    ieee154e_vars.state = newstate;
+   // record the state change in the timing trace
+   traceRecord(newstate);
    // wiggle the FSM debug pin
    switch (ieee154e_vars.state) {
       case S_SYNCLISTEN:
@@ -1803,6 +2508,9 @@ will do that for you, but assume that something went wrong.
 void endSlot() {
   
    float aux; //duty cycle helper.
+#ifdef OPENQUEUE_TTL_SLOTS
+   OpenQueueEntry_t* expired;
+#endif
    // turn off the radio
    radio_rfOff();
    // compute the duty cycle if radio has been turned on
@@ -1829,7 +2537,7 @@ void endSlot() {
       // getting here means transmit failed
       
       // indicate Tx fail to schedule to update stats
-      schedule_indicateTx(&ieee154e_vars.asn,FALSE);
+      schedule_indicateTx(&ieee154e_vars.asn,FALSE,&ieee154e_vars.dataToSend->l2_nextORpreviousHop);
       
       //decrement transmits left counter
       ieee154e_vars.dataToSend->l2_retriesLeft--;
@@ -1858,6 +2566,8 @@ void endSlot() {
    
    // clean up ackToSend
    if (ieee154e_vars.ackToSend!=NULL) {
+      // the ACK was not sent, the transmitter does not continue a burst
+      ieee154e_vars.burst = BURST_NONE;
       // free ackToSend so corresponding RAM memory can be recycled
       openqueue_freePacketBuffer(ieee154e_vars.ackToSend);
       // reset local variable
@@ -1872,6 +2582,25 @@ void endSlot() {
       ieee154e_vars.ackReceived = NULL;
    }
    
+   // periodically re-evaluate the channel blacklist; count slots since the
+   // last evaluation, as endSlot() does not run in the serial slots
+   if ((uint16_t)(ieee154e_vars.asn.bytes0and1-ieee154e_vars.blacklistAsn0and1)>=BLACKLIST_PERIOD) {
+      ieee154e_vars.blacklistAsn0and1 = ieee154e_vars.asn.bytes0and1;
+      updateChannelBlacklist();
+   }
+   
+#ifdef OPENQUEUE_TTL_SLOTS
+   // give up on a packet which waited too long for the MAC, at most one per slot
+   expired = openqueue_macGetExpiredPacket();
+   if (expired!=NULL) {
+      notif_sendDone(expired,E_FAIL);
+   }
+#endif
+   
+   // prepare the next slot while the radio is idle
+   if (ieee154e_vars.isSync==TRUE) {
+      prepareSlot(TRUE);
+   }
    
    // change state
    changeState(S_SLEEP);
@@ -17,11 +17,28 @@
 //=========================== define ==========================================
 
 #define SYNCHRONIZING_CHANNEL       20 // channel the mote listens on to synchronize
+#define NUM_CHANNELS                16 // number of channels in the hopping sequence
+#define CHANNEL_BLACKLIST       0x0000 // bit (channel-11) set to not use that channel, see ieee154e_setChannelBlacklist()
+#define BLACKLIST_PERIOD          1024 // in slots: how often the channel statistics are evaluated
+#define BLACKLIST_MINTX              8 // min number of ACK-requesting transmissions on a channel before judging it
+#define BLACKLIST_MINRX              8 // min number of receptions on a channel before judging it
+#define BLACKLIST_MINPDR            50 // in %: a channel with fewer of its transmissions ACKed gets blacklisted
+#define BLACKLIST_MAXCRCFAIL        50 // in %: a channel with more of its receptions failing the CRC gets blacklisted
+#define BLACKLIST_HOLD               4 // in BLACKLIST_PERIODs: how long a bad channel remains blacklisted
+#define BLACKLIST_MAXCHANNELS        8 // max number of channels the adaptive blacklist removes
 #define TXRETRIES                    3 // number of MAC retries before declaring failed
 #define TX_POWER                    31 // 1=-25dBm, 31=0dBm (max value)
 #define RESYNCHRONIZATIONGUARD       5 // in 32kHz ticks. min distance to the end of the slot to succesfully synchronize
 #define US_PER_TICK                 30 // number of us per 32kHz clock tick
-#define KATIMEOUT                   66 // in slots: @15ms per slot -> ~1 seconds
+#define KATIMEOUT                   66 // in slots: @15ms per slot -> ~1 seconds, until the clock drift is known
+#define KATIMEOUT_MIN               33 // in slots: shortest KA timeout, for a large clock drift
+#define KATIMEOUT_MAX              166 // in slots: longest KA timeout, for a small clock drift
+#define KATIMEOUT_GUARD             10 // in 32kHz ticks: drift-induced uncertainty at which a KA is due
+#define NUMTIMESOURCES               2 // number of time sources a clock drift estimate is kept for
+#define DRIFT_MINSAMPLES             4 // resynchronizations to a time source before its drift estimate is used
+#define DRIFT_MINSLOTS              33 // in slots: min time between resynchronizations to sample the drift
+#define DRIFT_MAXPPM               200 // in ppm: larger drift samples are considered errors
+#define GUARDTIME_MIN               10 // in 32kHz ticks: guard time left for timing jitter once the drift is known
 #define DESYNCTIMEOUT              333 // in slots: @15ms per slot -> ~5 seconds
 #define LIMITLARGETIMECORRECTION     5 // threshold number of ticks to declare a timeCorrection "large"
 #define LENGTH_IEEE154_MAX         128 // max length of a valid radio packet  
@@ -39,6 +56,46 @@ bit after the start of the packet.
 */
 #define FIRST_FRAME_BYTE             1
 
+/**
+\brief Uncomment to disable channel hopping.
+
+All slots then use #SYNCHRONIZING_CHANNEL. This allows you to use a
+single-channel sniffer; but you can not schedule two links on two different
+channel offsets in the same slot.
+*/
+//#define SINGLE_CHANNEL
+
+/**
+\brief Uncomment to trace the timing of the state machine.
+
+The last #IEEE802154E_TRACE_LENGTH state changes and interrupt entries/exits
+are kept in a ring buffer, with the value of the slot timer when they happened.
+The trace is frozen when the MAC logs an error, and printed over serial (see
+debugPrint_trace()). Must be a power of 2.
+*/
+//#define IEEE802154E_TRACE_LENGTH    64
+#define IEEE802154E_TRACE_PRINTMAX  16 // max number of trace entries printed at once
+
+// what the next slot is used for, when no cell is scheduled in it
+enum ieee154e_burst_enum {
+   BURST_NONE                = 0x00,   // nothing, the slot is idle
+   BURST_TX                  = 0x01,   // send the next packet of a burst to burstNeighbor
+   BURST_RX                  = 0x02,   // listen for the next packet of a burst from burstNeighbor
+};
+
+// events recorded in the trace, besides the state changes (ieee154e_state_t)
+enum ieee154e_traceEvents_enum {
+   TRACE_ISR_ENTER           = 0x40,   // OR'ed with the ieee154e_traceIsr_enum below
+   TRACE_ISR_EXIT            = 0x80,   // OR'ed with the ieee154e_traceIsr_enum below
+};
+
+enum ieee154e_traceIsr_enum {
+   TRACE_ISR_NEWSLOT         = 0x00,
+   TRACE_ISR_TIMER           = 0x01,
+   TRACE_ISR_STARTOFFRAME    = 0x02,
+   TRACE_ISR_ENDOFFRAME      = 0x03,
+};
+
 // the different states of the IEEE802.15.4e state machine
 typedef enum {
    S_SLEEP                   = 0x00,   // ready for next slot
@@ -110,9 +167,9 @@ enum ieee154e_atomicdurations_enum {
 #define DURATION_tt7 ieee154e_vars.lastCapturedTime+TsTxAckDelay+TsShortGT
 #define DURATION_tt8 ieee154e_vars.lastCapturedTime+wdAckDuration
 // RX
-#define DURATION_rt1 ieee154e_vars.lastCapturedTime+TsTxOffset-TsLongGT-delayRx-maxRxDataPrepare
-#define DURATION_rt2 ieee154e_vars.lastCapturedTime+TsTxOffset-TsLongGT-delayRx
-#define DURATION_rt3 ieee154e_vars.lastCapturedTime+TsTxOffset+TsLongGT
+#define DURATION_rt1 ieee154e_vars.lastCapturedTime+TsTxOffset-ieee154e_vars.rxGuardTime-delayRx-maxRxDataPrepare
+#define DURATION_rt2 ieee154e_vars.lastCapturedTime+TsTxOffset-ieee154e_vars.rxGuardTime-delayRx
+#define DURATION_rt3 ieee154e_vars.lastCapturedTime+TsTxOffset+ieee154e_vars.rxGuardTime
 #define DURATION_rt4 ieee154e_vars.lastCapturedTime+wdDataDuration
 #define DURATION_rt5 ieee154e_vars.lastCapturedTime+TsTxAckDelay-delayTx-maxTxAckPrepare
 #define DURATION_rt6 ieee154e_vars.lastCapturedTime+TsTxAckDelay-delayTx
@@ -126,15 +183,75 @@ typedef struct {
    PORT_SIGNED_INT_WIDTH timeCorrection;
 } IEEE802154E_ACK_ht;
 
-#define ADV_PAYLOAD_LENGTH 5
+#define ADV_PAYLOAD_LENGTH 7 // ASN (5B) + channel blacklist (2B)
+
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t            numTx;                // unicast transmissions which requested an ACK
+   uint8_t            numTxAck;             // ... of which an ACK was received
+   uint8_t            numRx;                // frames received with a valid CRC
+   uint8_t            numRxCrcFail;         // frames received with an invalid CRC
+   uint8_t            blacklistHold;        // evaluations left before this channel is used again (DAGroot only)
+} ieee154e_channelStats_t;
+PRAGMA(pack());
+
+/**
+\brief An event of the timing trace, as printed in a #STATUS_TRACE frame.
+
+The frame is the 2-byte little endian index of its first event, followed by
+up to #IEEE802154E_TRACE_PRINTMAX of these entries, in the order they were
+recorded. time is in the byte order of the mote, and is as wide as
+PORT_TIMER_WIDTH (2 bytes on most boards, 4 on some).
+
+To decode:
+- event<0x40 is the state the MAC enters, a ieee154e_state_t.
+- otherwise, bit 0x40 (enter) or 0x80 (exit) is set, and the low bits are the
+  ieee154e_traceIsr_enum of the interrupt.
+- the slot timer restarts at every TRACE_ISR_NEWSLOT. An event with the same
+  asn0 as the previous one happened (time-previous time) ticks after it; when
+  asn0 changed, add TsSlotDuration for each slot in between.
+
+The time spent in a state is the time from its event to the next state
+change. Summing it per state gives a duration histogram of the state machine.
+An index that does not follow the previous frame means events were lost, and
+the first duration after the gap must be discarded.
+*/
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t            asn0;                 // LSB of the ASN when the event happened
+   uint8_t            event;                // new ieee154e_state_t, or TRACE_ISR_ENTER/EXIT|ieee154e_traceIsr_enum
+   PORT_TIMER_WIDTH   time;                 // value of the slot timer when the event happened
+} ieee154e_traceEntry_t;
+PRAGMA(pack());
+
+// clock drift of a time source, learnt from the time corrections
+typedef struct {
+   open_addr_t        address;              // the time source, ADDR_NONE if this entry is unused
+   asn_t              lastSyncAsn;          // when I last resynchronized to it
+   int16_t            driftPpm;             // estimated drift of its clock relative to mine, in ppm
+   uint16_t           driftDevPpm;          // mean deviation of the samples from driftPpm, in ppm
+   uint8_t            numSamples;           // number of samples the estimate is based on (saturates)
+} ieee154e_drift_t;
+
+// everything the MAC needs to start a slot, prepared at the end of the previous one
+typedef struct {
+   bool               prepared;             // TRUE once filled in
+   uint16_t           asn0and1;             // 2 LSBs of the ASN of the slot described
+   cellType_t         cellType;             // type of the cell used, CELLTYPE_OFF if none
+   uint8_t            freq;                 // frequency of the slot
+   OpenQueueEntry_t*  dataToSend;           // packet to send in that slot, NULL if none
+   bool               txDeferred;           // TRUE if a packet was held back by the backoff
+   uint8_t            txGeneration;         // openqueue_macGetTxGeneration() when dataToSend was looked up
+   bool               burst;                // TRUE if this idle slot continues a burst
+   PORT_TIMER_WIDTH   firstTimeout;         // when to fire tt1 (sending) or rt1 (listening)
+} ieee154e_slotDesc_t;
 
 //=========================== module variables ================================
 
 typedef struct {
    // misc
    asn_t              asn;                  // current absolute slot number
-   slotOffset_t       slotOffset;           // current slot offset
-   slotOffset_t       nextActiveSlotOffset; // next active slot offset
+   slotOffset_t       slotOffset;           // current slot offset (in the default slotframe)
    PORT_TIMER_WIDTH   deSyncTimeout;        // how many slots left before looses sync
    bool               isSync;               // TRUE iff mote is synchronized to network
    // as shown on the chronogram
@@ -147,11 +264,30 @@ typedef struct {
    PORT_TIMER_WIDTH   syncCapturedTime;     // captured time used to sync
    //channel hopping
    uint8_t            freq;                 // frequency of the current slot
-   uint8_t            asnOffset;            // offset inside the frame
+   uint8_t            asnOffset;            // ASN modulo NUM_CHANNELS
+   uint8_t            hoppingSequence[NUM_CHANNELS]; // channel used at each asnOffset, blacklisted channels replaced
+   uint16_t           channelBlacklist;     // bit (channel-11) set if that channel is not used
+   ieee154e_slotDesc_t nextSlot;            // description of the next slot
+   ieee154e_channelStats_t channelStats[NUM_CHANNELS]; // link statistics, indexed by channel-11
+   uint16_t           blacklistAsn0and1;    // bytes0and1 of the ASN of the last blacklist evaluation
+   // clock drift
+   ieee154e_drift_t   drift[NUMTIMESOURCES]; // drift estimates of the last time sources
+   uint8_t            timeSource;           // index in drift of the time source I last resynchronized to
+   PORT_TIMER_WIDTH   rxGuardTime;          // guard time when receiving data, set when the slot is prepared
+   // burst transmission
+   uint8_t            burst;                // use of the next slot if idle, see ieee154e_burst_enum
+   open_addr_t        burstNeighbor;        // neighbor the burst is exchanged with
    
    PORT_TIMER_WIDTH radioOnInit;  //when within the slot the radio turns on
    PORT_TIMER_WIDTH radioOnTics;//how many tics within the slot the radio is on
    bool             radioOnThisSlot; //to control if the radio has been turned on in a slot.
+#ifdef IEEE802154E_TRACE_LENGTH
+   // timing trace
+   ieee154e_traceEntry_t trace[IEEE802154E_TRACE_LENGTH]; // ring buffer
+   uint16_t           traceNumWritten;      // number of events recorded since boot
+   uint16_t           traceNumPrinted;      // number of events printed over serial since boot
+   bool               traceFrozen;          // TRUE if an error froze the trace until it is printed
+#endif
 } ieee154e_vars_t;
 
 PRAGMA(pack(1));
@@ -170,6 +306,8 @@ typedef struct {
    PORT_TIMER_WIDTH          num_timer;
    PORT_TIMER_WIDTH          num_startOfFrame;
    PORT_TIMER_WIDTH          num_endOfFrame;
+   PORT_TIMER_WIDTH          num_slotNotPrepared; // slots which had to be prepared at their start
+   PORT_TIMER_WIDTH          num_burstSlot; // idle slots used to continue a burst
 } ieee154e_dbg_t;
 
 //=========================== prototypes ======================================
@@ -180,6 +318,11 @@ void               ieee154e_init();
 PORT_TIMER_WIDTH   ieee154e_asnDiff(asn_t* someASN);
 bool               ieee154e_isSynch();
 void               ieee154e_getAsn(uint8_t* array);
+void               ieee154e_getAsnStruct(asn_t* asn);
+void               ieee154e_setChannelBlacklist(uint16_t blacklist);
+void               ieee154e_freezeTrace();
+void               ieee154e_forgetPacket(OpenQueueEntry_t* pkt);
+uint16_t           ieee154e_getKaTimeout();
 // events
 void               ieee154e_startOfFrame(PORT_TIMER_WIDTH capturedTime);
 void               ieee154e_endOfFrame(PORT_TIMER_WIDTH capturedTime);
@@ -187,6 +330,8 @@ void               ieee154e_endOfFrame(PORT_TIMER_WIDTH capturedTime);
 bool               debugPrint_asn();
 bool               debugPrint_isSync();
 bool               debugPrint_macStats();
+bool               debugPrint_channelStats();
+bool               debugPrint_trace();
 
 /**
 \}
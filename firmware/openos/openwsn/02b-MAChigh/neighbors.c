@@ -129,25 +129,27 @@ This function iterates through the neighbor table and identifies the neighbor
 we need to send a KA to, if any. This neighbor satisfies the following
 conditions:
 - it is one of our preferred parents
-- we haven't heard it for over KATIMEOUT
+- we haven't heard it for over the KA timeout (see ieee154e_getKaTimeout())
 
 \returns A pointer to the neighbor's address, or NULL if no KA is needed.
 */
 open_addr_t* neighbors_getKANeighbor() {
    uint8_t         i;
    uint16_t        timeSinceHeard;
+   uint16_t        kaTimeout;
    open_addr_t*    addrPreferred;
    open_addr_t*    addrOther;
    
    // initialize
    addrPreferred = NULL;
    addrOther     = NULL;
+   kaTimeout     = ieee154e_getKaTimeout();
    
    // scan through the neighbor table, and populate addrPreferred and addrOther
    for (i=0;i<MAXNUMNEIGHBORS;i++) {
       if (neighbors_vars.neighbors[i].used==1) {
          timeSinceHeard = ieee154e_asnDiff(&neighbors_vars.neighbors[i].asn);
-         if (timeSinceHeard>KATIMEOUT) {
+         if (timeSinceHeard>kaTimeout) {
             // this neighbor needs to be KA'ed to
             if (neighbors_vars.neighbors[i].parentPreference==MAXPREFERENCE) {
                // its a preferred parent
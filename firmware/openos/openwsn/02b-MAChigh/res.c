@@ -20,7 +20,7 @@ res_vars_t res_vars;
 owerror_t res_send_internal(OpenQueueEntry_t* msg);
 void    sendAdv();
 void    sendKa();
-void    res_timer_cb();
+void    timers_res_fired();
 
 //=========================== public ==========================================
 
@@ -30,9 +30,11 @@ void res_init() {
    res_vars.busySendingAdv    = FALSE;
    res_vars.dsn               = 0;
    res_vars.MacMgtTaskCounter = 0;
-   res_vars.timerId = opentimers_start(res_vars.periodMaintenance,
-                                       TIMER_PERIODIC,TIME_MS,
-                                       res_timer_cb);
+   res_vars.timerId = opentimers_startTask(res_vars.periodMaintenance,
+                                           0,
+                                           TIMER_PERIODIC,TIME_MS,
+                                           timers_res_fired,
+                                           TASKPRIO_RES);
 }
 
 /**
@@ -218,7 +220,7 @@ owerror_t res_send_internal(OpenQueueEntry_t* msg) {
    // reserve space for 2-byte CRC
    packetfunctions_reserveFooterSize(msg,2);
    // change owner to IEEE802154E fetches it from queue
-   msg->owner  = COMPONENT_RES_TO_IEEE802154E;
+   openqueue_resSendToMac(msg);
    return E_SUCCESS;
 }
 
@@ -252,7 +254,7 @@ port_INLINE void sendAdv() {
    // if I get here, I will send an ADV
    
    // get a free packet buffer
-   adv = openqueue_getFreePacketBuffer(COMPONENT_RES);
+   adv = openqueue_getFreeSmallPacketBuffer(COMPONENT_RES);
    if (adv==NULL) {
       openserial_printError(COMPONENT_RES,ERR_NO_FREE_PACKET_BUFFER,
                             (errorparameter_t)0,
@@ -320,7 +322,7 @@ port_INLINE void sendKa() {
    // if I get here, I will send a KA
    
    // get a free packet buffer
-   kaPkt = openqueue_getFreePacketBuffer(COMPONENT_RES);
+   kaPkt = openqueue_getFreeSmallPacketBuffer(COMPONENT_RES);
    if (kaPkt==NULL) {
       openserial_printError(COMPONENT_RES,ERR_NO_FREE_PACKET_BUFFER,
                             (errorparameter_t)1,
@@ -341,8 +343,4 @@ port_INLINE void sendKa() {
    
    // I'm now busy sending a KA
    res_vars.busySendingKa = TRUE;
-}
-
-void res_timer_cb() {
-   scheduler_push_task(timers_res_fired,TASKPRIO_RES);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "openserial.h"
 #include "openrandom.h"
 #include "packetfunctions.h"
+#include "openqueue.h"
 
 //=========================== variables =======================================
 
@@ -11,7 +12,16 @@ schedule_dbg_t schedule_dbg;
 
 //=========================== prototypes ======================================
 
-void schedule_resetEntry(scheduleEntry_t* pScheduleEntry);
+void             schedule_resetEntry(scheduleEntry_t* pScheduleEntry);
+void             schedule_removeRows(uint8_t first, uint8_t last);
+backoff_t*       schedule_getBackoff(open_addr_t* neighbor, bool create);
+uint8_t          schedule_lowerBound(uint8_t slotframeHandle, slotOffset_t slotOffset);
+scheduleEntry_t* schedule_findEntry(uint8_t slotframeHandle, slotOffset_t slotOffset, open_addr_t* neighbor);
+bool             schedule_isActiveSlot(uint8_t slotframeHandle, slotOffset_t slotOffset);
+void             schedule_updateBitmap(uint8_t slotframeHandle, slotOffset_t slotOffset);
+bool             schedule_findCurrent();
+bool             schedule_hasTraffic(scheduleEntry_t* entry);
+slotOffset_t     schedule_asnModulo(asn_t* asn, frameLength_t frameLength);
 
 //=========================== public ==========================================
 
@@ -27,10 +37,10 @@ void schedule_init() {
    for (i=0;i<MAXACTIVESLOTS;i++) {
       schedule_resetEntry(&schedule_vars.scheduleBuf[i]);
    }
-   schedule_vars.backoffExponent = MINBE-1;
+   schedule_resetBackoff();
    memset(&schedule_dbg, 0,sizeof(schedule_dbg_t));
 
-   // set frame length
+   // set frame length of the default slotframe
    schedule_setFrameLength(SUPERFRAME_LENGTH);
    
    // start at slot 0
@@ -40,6 +50,7 @@ void schedule_init() {
    memset(&temp_neighbor,0,sizeof(temp_neighbor));
    for (i=0;i<NUMADVSLOTS;i++) {
       schedule_addActiveSlot(
+         SLOTFRAME_DEFAULT,       // slotframe
          running_slotOffset,      // slot offset
          CELLTYPE_ADV,            // type of slot
          FALSE,                   // shared?
@@ -55,6 +66,7 @@ void schedule_init() {
    temp_neighbor.type             = ADDR_ANYCAST;
    for (i=0;i<NUMSHAREDTXRX;i++) {
       schedule_addActiveSlot(
+         SLOTFRAME_DEFAULT,       // slotframe
          running_slotOffset,      // slot offset
          CELLTYPE_TXRX,           // type of slot
          TRUE,                    // shared?
@@ -68,6 +80,7 @@ void schedule_init() {
    // serial RX slot(s)
    memset(&temp_neighbor,0,sizeof(temp_neighbor));
    schedule_addActiveSlot(
+      SLOTFRAME_DEFAULT,          // slotframe
       running_slotOffset,         // slot offset
       CELLTYPE_SERIALRX,          // type of slot
       FALSE,                      // shared?
@@ -79,6 +92,7 @@ void schedule_init() {
    /*
    for (i=0;i<NUMSERIALRX-1;i++) {
       schedule_addActiveSlot(
+         SLOTFRAME_DEFAULT,       // slotframe
          running_slotOffset,      // slot offset
          CELLTYPE_MORESERIALRX,   // type of slot
          FALSE,                   // shared?
@@ -146,109 +160,176 @@ status information about several modules in the OpenWSN stack.
 \returns TRUE if this function printed something, FALSE otherwise.
 */
 bool debugPrint_backoff() {
-   uint8_t temp[2];
-   temp[0] = schedule_vars.backoffExponent;
-   temp[1] = schedule_vars.backoff;
+   debugBackoff_t temp;
+   backoff_t*     backoff;
+   uint8_t        i;
+   
+   memset(&temp,0,sizeof(debugBackoff_t));
+   for (i=0;i<schedule_vars.numActiveSlots+NUMNBRBACKOFF;i++) {
+      if (i<schedule_vars.numActiveSlots) {
+         backoff = &schedule_vars.scheduleBuf[i].backoff;
+      } else {
+         backoff = &schedule_vars.nbrBackoff[i-schedule_vars.numActiveSlots].backoff;
+      }
+      if (backoff->backoffExponent>=MINBE) {
+         temp.numBackingOff++;
+      }
+      if (backoff->backoffExponent>temp.backoffExponent) {
+         temp.backoffExponent = backoff->backoffExponent;
+      }
+      if (backoff->backoff>temp.backoff) {
+         temp.backoff         = backoff->backoff;
+      }
+   }
+   temp.numTxDeferred         = schedule_dbg.numTxDeferred;
+   temp.numSharedTxFail       = schedule_dbg.numSharedTxFail;
+   
    openserial_printStatus(STATUS_BACKOFF,
          (uint8_t*)&temp,
-         sizeof(temp));
+         sizeof(debugBackoff_t));
    return TRUE;
 }
 
 //=== from uRES (writing the schedule)
 
 /**
-\brief Set frame length.
+\brief Set frame length of the default slotframe.
 
 \param newFrameLength The new frame length.
 */
 void schedule_setFrameLength(frameLength_t newFrameLength) {
+   schedule_setSlotframe(SLOTFRAME_DEFAULT,newFrameLength);
+}
+
+/**
+\brief Create, resize or delete a slotframe.
+
+The slotframe is aligned on the ASN: its slot offset is ASN%frameLength.
+Deleting a slotframe removes its cells from the schedule; shrinking it removes
+its cells at a slot offset past the new end.
+
+\param slotframeHandle The handle of the slotframe, also its priority (0 is
+   the highest).
+\param frameLength     The new frame length, 0 to delete the slotframe.
+
+\returns E_SUCCESS if the slotframe was set, E_FAIL if the handle is invalid.
+*/
+owerror_t schedule_setSlotframe(uint8_t slotframeHandle, frameLength_t frameLength) {
+   slotframe_t* slotframe;
+   slotOffset_t i;
    INTERRUPT_DECLARATION();
+   
+   if (slotframeHandle>=MAXSLOTFRAMES) {
+      return E_FAIL;
+   }
+   
    DISABLE_INTERRUPTS();
-   schedule_vars.frameLength = newFrameLength;
+   slotframe = &schedule_vars.slotframes[slotframeHandle];
+   
+   // remove the cells past the end, they occupy consecutive rows
+   schedule_removeRows(
+      schedule_lowerBound(slotframeHandle,frameLength),
+      schedule_lowerBound(slotframeHandle+1,0)
+   );
+   for (i=frameLength;i<MAXFRAMELENGTH;i++) {
+      slotframe->activeSlotBitmap[i/8] &= ~(1<<(i%8));
+   }
+   
+   if (frameLength==0) {
+      slotframe->slotOffset         = 0;
+   } else {
+      slotframe->slotOffset         = schedule_asnModulo(&schedule_vars.lastAsn,frameLength);
+   }
+   slotframe->frameLength           = frameLength;
    ENABLE_INTERRUPTS();
+   
+   return E_SUCCESS;
 }
 
 /**
 \brief get the information of a spcific slot.
 
+\param slotframeHandle
 \param slotoffset
 \param neighbour address
 */
-void  schedule_getSlotInfo(slotOffset_t   slotOffset,                      
+void  schedule_getSlotInfo(uint8_t slotframeHandle,
+                              slotOffset_t   slotOffset,                      
                               open_addr_t*   neighbor,
                               slotinfo_element_t* info){                            
-                           
    scheduleEntry_t* slotContainer;
-  
-   // find an empty schedule entry container
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (slotContainer->type!=CELLTYPE_OFF && slotContainer<=&schedule_vars.scheduleBuf[MAXACTIVESLOTS-1]) {
-       //check that this entry for that neighbour and timeslot is not already scheduled.
-       if (packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))&& (slotContainer->slotOffset==slotOffset)){
-               //it exists so this is an update.
-               info->link_type                 = slotContainer->type;
-               info->shared                    =slotContainer->shared;
-               info->channelOffset             = slotContainer->channelOffset;
-               return; //as this is an update. No need to re-insert as it is in the same position on the list.
-        }
-        slotContainer++;
-   }
-   //return cell type off.
-   info->link_type                 = CELLTYPE_OFF;
-   info->shared                    = FALSE;
-   info->channelOffset             = 0;//set to zero if not set.                          
+   INTERRUPT_DECLARATION();
+   
+   DISABLE_INTERRUPTS();
+   slotContainer = schedule_findEntry(slotframeHandle,slotOffset,neighbor);
+   if (slotContainer!=NULL) {
+      info->link_type                 = slotContainer->type;
+      info->shared                    = slotContainer->shared;
+      info->channelOffset             = slotContainer->channelOffset;
+   } else {
+      //return cell type off.
+      info->link_type                 = CELLTYPE_OFF;
+      info->shared                    = FALSE;
+      info->channelOffset             = 0;//set to zero if not set.
+   }
+   ENABLE_INTERRUPTS();
 }
 
-
-
-
 /**
 \brief Add a new active slot into the schedule. If udpate param is set then update it in case it exists.
 
+The row is inserted after the existing rows of the same slotframe with the same
+or a smaller slot offset, so scheduleBuf stays sorted.
+
+Several cells can share a slot offset, as long as they are for different
+neighbors; see schedule_findCurrent() for which one is used. Several cells to
+the same neighbor (at different slot offsets) form a bundle: the MAC serves the
+neighbor's queue in whichever of them comes first.
+
+\param slotframeHandle
 \param slotOffset
 \param type
 \param shared
 \param channelOffset
 \param neighbor
 */
-owerror_t schedule_addActiveSlot(slotOffset_t    slotOffset,
+owerror_t schedule_addActiveSlot(uint8_t         slotframeHandle,
+      slotOffset_t    slotOffset,
       cellType_t      type,
       bool            shared,
       channelOffset_t channelOffset,
       open_addr_t*    neighbor,
       bool isUpdate) {
    
-   owerror_t outcome;
-   
    scheduleEntry_t* slotContainer;
-   scheduleEntry_t* previousSlotWalker;
-   scheduleEntry_t* nextSlotWalker;
+   uint8_t          i;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   
-   // find an empty schedule entry container
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (slotContainer->type!=CELLTYPE_OFF &&
-         slotContainer<=&schedule_vars.scheduleBuf[MAXACTIVESLOTS-1]) {
-  
-           //check that this entry for that neighbour and timeslot is not already scheduled.
-           if (type!=CELLTYPE_SERIALRX && type!=CELLTYPE_MORESERIALRX &&  
-               (packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))||
-                 (slotContainer->neighbor.type==ADDR_ANYCAST && isUpdate==TRUE))
-                 &&(slotContainer->slotOffset==slotOffset)){
-               //it exists so this is an update.
-               slotContainer->type                      = type;
-               slotContainer->shared                    = shared;
-               slotContainer->channelOffset             = channelOffset;
-               memcpy(&slotContainer->neighbor,neighbor,sizeof(open_addr_t));//update the address too!
-               schedule_dbg.numUpdatedSlotsCur++;
-               ENABLE_INTERRUPTS();
-               return E_SUCCESS; //as this is an update. No need to re-insert as it is in the same position on the list.
-           }
-           
-           slotContainer++;
+   // check that this entry for that neighbour and timeslot is not already scheduled.
+   if (type!=CELLTYPE_SERIALRX && type!=CELLTYPE_MORESERIALRX && schedule_isActiveSlot(slotframeHandle,slotOffset)) {
+      i = schedule_lowerBound(slotframeHandle,slotOffset);
+      while (
+            i<schedule_vars.numActiveSlots                                  &&
+            schedule_vars.scheduleBuf[i].slotframeHandle==slotframeHandle   &&
+            schedule_vars.scheduleBuf[i].slotOffset==slotOffset
+         ) {
+         slotContainer = &schedule_vars.scheduleBuf[i];
+         if (
+               packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor)) ||
+               (slotContainer->neighbor.type==ADDR_ANYCAST && isUpdate==TRUE)
+            ) {
+            //it exists so this is an update.
+            slotContainer->type                      = type;
+            slotContainer->shared                    = shared;
+            slotContainer->channelOffset             = channelOffset;
+            memcpy(&slotContainer->neighbor,neighbor,sizeof(open_addr_t));//update the address too!
+            schedule_dbg.numUpdatedSlotsCur++;
+            ENABLE_INTERRUPTS();
+            return E_SUCCESS; //as this is an update. No need to re-insert as it is in the same position on the list.
+         }
+         i++;
+      }
    }
    
    if (isUpdate==TRUE) {
@@ -256,172 +337,188 @@ owerror_t schedule_addActiveSlot(slotOffset_t    slotOffset,
      ENABLE_INTERRUPTS();
      return E_FAIL;
    }
-   if (slotContainer>&schedule_vars.scheduleBuf[MAXACTIVESLOTS-1]) {
+   
+   if (
+         slotframeHandle>=MAXSLOTFRAMES                   ||
+         schedule_vars.numActiveSlots==MAXACTIVESLOTS     ||
+         slotOffset>=MAXFRAMELENGTH
+      ) {
       // schedule has overflown
-      outcome=E_FAIL;
+      ENABLE_INTERRUPTS();
       openserial_printCritical(COMPONENT_SCHEDULE,ERR_SCHEDULE_OVERFLOWN,
-                            (errorparameter_t)0,
-                            (errorparameter_t)0);
-      
-      
+                            (errorparameter_t)slotOffset,
+                            (errorparameter_t)schedule_vars.numActiveSlots);
+      return E_FAIL;
    }
+   
+   // make room after the rows with the same or a smaller slot offset
+   i = schedule_lowerBound(slotframeHandle,slotOffset+1);
+   memmove(
+      &schedule_vars.scheduleBuf[i+1],
+      &schedule_vars.scheduleBuf[i],
+      (schedule_vars.numActiveSlots-i)*sizeof(scheduleEntry_t)
+   );
+   if (schedule_vars.numActiveSlots>0 && i<=schedule_vars.currentEntry) {
+      // the current cell moved down one row
+      schedule_vars.currentEntry++;
+   }
+   schedule_vars.numActiveSlots++;
+   
    // fill that schedule entry with parameters passed
+   slotContainer = &schedule_vars.scheduleBuf[i];
+   schedule_resetEntry(slotContainer);
+   slotContainer->slotframeHandle           = slotframeHandle;
    slotContainer->slotOffset                = slotOffset;
    slotContainer->type                      = type;
    slotContainer->shared                    = shared;
    slotContainer->channelOffset             = channelOffset;
    memcpy(&slotContainer->neighbor,neighbor,sizeof(open_addr_t));
-
-   if (schedule_vars.currentScheduleEntry==NULL) {
-      // this is the first active slot added
-
-      // the next slot of this slot is this slot
-      slotContainer->next                   = slotContainer;
-
-      // current slot points to this slot
-      schedule_vars.currentScheduleEntry    = slotContainer;
-   } else  {
-      // this is NOT the first active slot added
-
-      // find position in schedule
-      previousSlotWalker                    = schedule_vars.currentScheduleEntry;
-      while (1) {
-         nextSlotWalker                     = previousSlotWalker->next;
-         if (
-               (
-                     (previousSlotWalker->slotOffset <  slotContainer->slotOffset) &&
-                     (slotContainer->slotOffset <  nextSlotWalker->slotOffset)
-               )
-               ||
-               (
-                     (previousSlotWalker->slotOffset <  slotContainer->slotOffset) &&
-                     (nextSlotWalker->slotOffset <= previousSlotWalker->slotOffset)
-               )
-               ||
-               (
-                     (slotContainer->slotOffset <  nextSlotWalker->slotOffset) &&
-                     (nextSlotWalker->slotOffset <= previousSlotWalker->slotOffset)
-               )
-         ) {
-            break;
-         }
-         previousSlotWalker                 = nextSlotWalker;
-      }
-      // insert between previousSlotWalker and nextSlotWalker
-      previousSlotWalker->next              = slotContainer;
-      slotContainer->next                   = nextSlotWalker;
-   }
-
+   
+   schedule_vars.slotframes[slotframeHandle].activeSlotBitmap[slotOffset/8] |= 1<<(slotOffset%8);
+   
    // maintain debug stats
    schedule_dbg.numActiveSlotsCur++;
    if (schedule_dbg.numActiveSlotsCur>schedule_dbg.numActiveSlotsMax) {
       schedule_dbg.numActiveSlotsMax        = schedule_dbg.numActiveSlotsCur;
    }
-   outcome=E_SUCCESS;
    ENABLE_INTERRUPTS();
-   return outcome;
+   return E_SUCCESS;
 }
 
+/**
+\brief Remove an active slot from the schedule.
 
+\param slotframeHandle
+\param slotOffset
+\param neighbor
 
-owerror_t   schedule_removeActiveSlot(slotOffset_t   slotOffset, open_addr_t*   neighbor){
-  
-   owerror_t outcome;
-   
+\returns E_SUCCESS if the slot was removed, E_FAIL if it was not scheduled.
+*/
+owerror_t   schedule_removeActiveSlot(uint8_t slotframeHandle, slotOffset_t   slotOffset, open_addr_t*   neighbor){
    scheduleEntry_t* slotContainer;
-   scheduleEntry_t* previousSlotWalker;
-
+   uint8_t          i;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   
    // find the schedule entry
-   slotContainer = &schedule_vars.scheduleBuf[0];
-   while (slotContainer->type!=CELLTYPE_OFF && slotContainer<=&schedule_vars.scheduleBuf[MAXACTIVESLOTS-1]) {
-          //check that this entry for that neighbour and timeslot is not already scheduled.
-           if (packetfunctions_sameAddress(neighbor,&(slotContainer->neighbor))&& (slotContainer->slotOffset==slotOffset)){
-               break;
-           }
-           slotContainer++;
+   slotContainer = schedule_findEntry(slotframeHandle,slotOffset,neighbor);
+   if (slotContainer==NULL) {
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
    }
-  
-   if (slotContainer->next==slotContainer) {
-      // this is the last active slot
+   i = slotContainer-&schedule_vars.scheduleBuf[0];
+   
+   // remove that row, the following ones move up
+   memmove(
+      &schedule_vars.scheduleBuf[i],
+      &schedule_vars.scheduleBuf[i+1],
+      (schedule_vars.numActiveSlots-i-1)*sizeof(scheduleEntry_t)
+   );
+   schedule_vars.numActiveSlots--;
+   schedule_resetEntry(&schedule_vars.scheduleBuf[schedule_vars.numActiveSlots]);
+   
+   // keep pointing at the current cell if it moved up
+   if (i<schedule_vars.currentEntry) {
+      schedule_vars.currentEntry--;
+   } else if (schedule_vars.currentEntry>=schedule_vars.numActiveSlots) {
+      schedule_vars.currentEntry = 0;
+   }
+   
+   schedule_updateBitmap(slotframeHandle,slotOffset);
+   
+   // maintain debug stats
+   schedule_dbg.numActiveSlotsCur--;
+   
+   ENABLE_INTERRUPTS();
+   return E_SUCCESS;
+}
 
-      // the next slot of this slot is NULL
-      slotContainer->next                   = NULL;
+//=== from IEEE802154E: reading the schedule and updating statistics
 
-      // current slot points to this slot
-      schedule_vars.currentScheduleEntry    = NULL;
-   } else  {
-      // this is NOT the last active slot
+/**
+\brief Align all slotframes on the ASN, typically after (re)synchronizing.
 
-      // find the previous in the schedule
-      previousSlotWalker                    = schedule_vars.currentScheduleEntry;
-      
-      while (1) {
-        if (previousSlotWalker->next=slotContainer){
-            break;
-         }
-         previousSlotWalker                 = previousSlotWalker->next;
+\param asn The ASN of the current slot.
+*/
+void schedule_syncAsn(asn_t* asn) {
+   uint8_t      i;
+   slotframe_t* slotframe;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   memcpy(&schedule_vars.lastAsn,asn,sizeof(asn_t));
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (slotframe->frameLength>0) {
+         slotframe->slotOffset = schedule_asnModulo(asn,slotframe->frameLength);
       }
-      // remove this element from the linked list
-      previousSlotWalker->next              = slotContainer->next;//my next;
-      slotContainer->next                   = NULL;
    }
-
-    // clear that schedule entry 
-    slotContainer->slotOffset                = 0;
-    slotContainer->type                      = CELLTYPE_OFF;
-    slotContainer->shared                    = FALSE;
-    slotContainer->channelOffset             = 0;
-    memset(&slotContainer->neighbor,0,sizeof(open_addr_t));
-
-    // maintain debug stats
-    schedule_dbg.numActiveSlotsCur--;
-   
-    outcome=E_SUCCESS;
-    ENABLE_INTERRUPTS();
-    
-    return outcome;
+   schedule_findCurrent();
+   ENABLE_INTERRUPTS();
 }
 
+/**
+\brief Move all slotframes to the slot at some ASN, and pick its cell.
 
+Called at the beginning of each slot. Slots skipped since the last call (e.g.
+while resynchronizing) are accounted for.
 
+When several cells are scheduled in that slot, in one or several slotframes,
+the current cell is the first cell with a packet to send, else the first cell
+the mote can receive in, else the first cell, looking at the slotframes by
+increasing handle; see schedule_findCurrent().
 
-//=== from IEEE802154E: reading the schedule and updating statistics
+\param asn The ASN of the new slot.
 
-void schedule_syncSlotOffset(slotOffset_t targetSlotOffset) {
+\returns TRUE if a cell is scheduled in that slot, FALSE otherwise.
+*/
+bool schedule_advanceSlot(asn_t* asn) {
+   uint16_t     numSlots;
+   uint8_t      i;
+   slotframe_t* slotframe;
+   bool         res;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   while (schedule_vars.currentScheduleEntry->slotOffset!=targetSlotOffset) {
-      schedule_advanceSlot();
+   numSlots = asn->bytes0and1-schedule_vars.lastAsn.bytes0and1;
+   memcpy(&schedule_vars.lastAsn,asn,sizeof(asn_t));
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (slotframe->frameLength>0) {
+         slotframe->slotOffset = ((uint32_t)slotframe->slotOffset+numSlots)%slotframe->frameLength;
+      }
    }
+   res = schedule_findCurrent();
    ENABLE_INTERRUPTS();
+   return res;
 }
 
-void schedule_advanceSlot() {
-   INTERRUPT_DECLARATION();
-   DISABLE_INTERRUPTS();
-   // advance to next active slot
-   schedule_vars.currentScheduleEntry = schedule_vars.currentScheduleEntry->next;
-   ENABLE_INTERRUPTS();
-}
+/**
+\brief Check whether a cell is scheduled in the slot after the current one.
 
-slotOffset_t schedule_getNextActiveSlotOffset() {
-   slotOffset_t res;   
+\returns TRUE if a cell is scheduled in the next slot, in any slotframe.
+*/
+bool schedule_isNextSlotActive() {
+   uint8_t      i;
+   slotframe_t* slotframe;
+   bool         res;
    INTERRUPT_DECLARATION();
-   
-   // return next active slot's slotOffset
    DISABLE_INTERRUPTS();
-   res = ((scheduleEntry_t*)(schedule_vars.currentScheduleEntry->next))->slotOffset;
+   res = FALSE;
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      slotframe = &schedule_vars.slotframes[i];
+      if (
+            slotframe->frameLength>0 &&
+            schedule_isActiveSlot(i,(slotframe->slotOffset+1)%slotframe->frameLength)==TRUE
+         ) {
+         res = TRUE;
+         break;
+      }
+   }
    ENABLE_INTERRUPTS();
-   
    return res;
 }
 
 /**
-\brief Get the frame length.
+\brief Get the frame length of the default slotframe.
 
 \returns The frame length.
 */
@@ -430,7 +527,7 @@ frameLength_t schedule_getFrameLength() {
    INTERRUPT_DECLARATION();
    
    DISABLE_INTERRUPTS();
-   res= schedule_vars.frameLength;
+   res= schedule_vars.slotframes[SLOTFRAME_DEFAULT].frameLength;
    ENABLE_INTERRUPTS();
    
    return res;
@@ -445,7 +542,7 @@ cellType_t schedule_getType() {
    cellType_t res;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   res= schedule_vars.currentScheduleEntry->type;
+   res= schedule_vars.scheduleBuf[schedule_vars.currentEntry].type;
    ENABLE_INTERRUPTS();
    return res;
 }
@@ -458,7 +555,7 @@ cellType_t schedule_getType() {
 void schedule_getNeighbor(open_addr_t* addrToWrite) {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   memcpy(addrToWrite,&(schedule_vars.currentScheduleEntry->neighbor),sizeof(open_addr_t));
+   memcpy(addrToWrite,&(schedule_vars.scheduleBuf[schedule_vars.currentEntry].neighbor),sizeof(open_addr_t));
    ENABLE_INTERRUPTS();
 }
 
@@ -471,7 +568,7 @@ channelOffset_t schedule_getChannelOffset() {
    channelOffset_t res;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   res= schedule_vars.currentScheduleEntry->channelOffset;
+   res= schedule_vars.scheduleBuf[schedule_vars.currentEntry].channelOffset;
    ENABLE_INTERRUPTS();
    return res;
 }
@@ -479,38 +576,45 @@ channelOffset_t schedule_getChannelOffset() {
 /**
 \brief Check whether I can send on this slot.
 
-This function is called at the beginning of every TX slot.
+This function is called at the beginning of every TX slot which has a packet to
+send.
 If the slot is *not* a shared slot, it always return TRUE.
 If the slot is a shared slot, it decrements the backoff counter and returns 
 TRUE only if it hits 0.
 
-Note that the backoff counter is global, not per slot.
+The backoff counter is kept per cell, or per neighbor in shared anycast cells,
+so collisions in one cell do not throttle the others.
+
+\param neighbor The next hop of the packet to send.
 
 \returns TRUE if it is OK to send on this slot, FALSE otherwise.
  */
-bool schedule_getOkToSend() {
-   bool returnVal;
+bool schedule_getOkToSend(open_addr_t* neighbor) {
+   backoff_t* backoff;
+   bool       returnVal;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   if (schedule_vars.currentScheduleEntry->shared==FALSE) {
-      // non-shared slot: backoff does not apply
+   backoff = schedule_getBackoff(neighbor,FALSE);
+   if (backoff==NULL) {
+      // non-shared slot, or neighbor not backing off
       
       returnVal = TRUE;
    } else {
-      // non-shared slot: check backoff before answering
+      // shared slot: check backoff before answering
       
       // decrement backoff
-      if (schedule_vars.backoff>0) {
-         schedule_vars.backoff--;
+      if (backoff->backoff>0) {
+         backoff->backoff--;
       }
       
       // only return TRUE if backoff hit 0
-      if (schedule_vars.backoff==0) {
+      if (backoff->backoff==0) {
          returnVal = TRUE;
       } else {
          returnVal = FALSE;
+         schedule_dbg.numTxDeferred++;
       }
    }
    
@@ -519,16 +623,22 @@ bool schedule_getOkToSend() {
 }
 
 /**
-\brief Reset the backoff and backoffExponent.
+\brief Reset the backoff and backoffExponent of all cells and neighbors.
 */
 void schedule_resetBackoff() {
+   uint8_t i;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    
-   // reset backoffExponent
-   schedule_vars.backoffExponent = MINBE-1;
-   // reset backoff
-   schedule_vars.backoff         = 0;
+   for (i=0;i<MAXACTIVESLOTS;i++) {
+      schedule_vars.scheduleBuf[i].backoff.backoffExponent = MINBE-1;
+      schedule_vars.scheduleBuf[i].backoff.backoff         = 0;
+   }
+   for (i=0;i<NUMNBRBACKOFF;i++) {
+      schedule_vars.nbrBackoff[i].neighbor.type            = ADDR_NONE;
+      schedule_vars.nbrBackoff[i].backoff.backoffExponent  = MINBE-1;
+      schedule_vars.nbrBackoff[i].backoff.backoff          = 0;
+   }
    
    ENABLE_INTERRUPTS();
 }
@@ -537,51 +647,66 @@ void schedule_resetBackoff() {
 \brief Indicate the reception of a packet.
 */
 void schedule_indicateRx(asn_t* asnTimestamp) {
+   scheduleEntry_t* current;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
+   current = &schedule_vars.scheduleBuf[schedule_vars.currentEntry];
    // increment usage statistics
-   schedule_vars.currentScheduleEntry->numRx++;
+   current->numRx++;
 
    // update last used timestamp
-   memcpy(&(schedule_vars.currentScheduleEntry->lastUsedAsn), asnTimestamp, sizeof(asn_t));
+   memcpy(&(current->lastUsedAsn), asnTimestamp, sizeof(asn_t));
    ENABLE_INTERRUPTS();
 }
 
 /**
 \brief Indicate the transmission of a packet.
+
+In shared cells, a successful transmission resets the backoff of that cell (or
+of that neighbor, in an anycast cell), a failed one increases it.
+
+\param asnTimestamp The ASN of the transmission.
+\param succesfullTx Whether the transmission was successful.
+\param neighbor     The next hop of the packet.
 */
-void schedule_indicateTx(asn_t* asnTimestamp,
-                         bool   succesfullTx) {
+void schedule_indicateTx(asn_t*       asnTimestamp,
+                         bool         succesfullTx,
+                         open_addr_t* neighbor) {
+   scheduleEntry_t* current;
+   backoff_t*       backoff;
    
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
+   current = &schedule_vars.scheduleBuf[schedule_vars.currentEntry];
    // increment usage statistics
-   if (schedule_vars.currentScheduleEntry->numTx==0xFF) {
-      schedule_vars.currentScheduleEntry->numTx/=2;
-      schedule_vars.currentScheduleEntry->numTxACK/=2;
+   if (current->numTx==0xFF) {
+      current->numTx/=2;
+      current->numTxACK/=2;
    }
-   schedule_vars.currentScheduleEntry->numTx++;
+   current->numTx++;
    if (succesfullTx==TRUE) {
-      schedule_vars.currentScheduleEntry->numTxACK++;
+      current->numTxACK++;
    }
 
    // update last used timestamp
-   memcpy(&schedule_vars.currentScheduleEntry->lastUsedAsn, asnTimestamp, sizeof(asn_t));
+   memcpy(&current->lastUsedAsn, asnTimestamp, sizeof(asn_t));
 
    // update this backoff parameters for shared slots
-   if (schedule_vars.currentScheduleEntry->shared==TRUE) {
+   backoff = schedule_getBackoff(neighbor,succesfullTx==FALSE);
+   if (backoff!=NULL) {
       if (succesfullTx==TRUE) {
          // reset backoffExponent
-         schedule_vars.backoffExponent = MINBE-1;
+         backoff->backoffExponent = MINBE-1;
          // reset backoff
-         schedule_vars.backoff         = 0;
+         backoff->backoff         = 0;
       } else {
          // increase the backoffExponent
-         if (schedule_vars.backoffExponent<MAXBE) {
-            schedule_vars.backoffExponent++;
+         if (backoff->backoffExponent<MAXBE) {
+            backoff->backoffExponent++;
          }
          // set the backoff to a random value in [0..2^BE]
-         schedule_vars.backoff         = openrandom_get16b()%(1<<schedule_vars.backoffExponent);
+         backoff->backoff         = openrandom_get16b()%(1<<backoff->backoffExponent);
+         schedule_dbg.numSharedTxFail++;
       }
    }
    
@@ -591,7 +716,7 @@ void schedule_indicateTx(asn_t* asnTimestamp,
 void schedule_getNetDebugInfo(netDebugScheduleEntry_t* schlist){  
   uint8_t i;
   
-  for (i=0;i<MAXACTIVESLOTS;i++){
+  for (i=0;i<MAXNETDEBUGSLOTS;i++){
    schlist[i].last_addr_byte=schedule_vars.scheduleBuf[i].neighbor.addr_64b[7];
    schlist[i].slotOffset=(uint8_t)schedule_vars.scheduleBuf[i].slotOffset&0xFF;
    schlist[i].channelOffset=schedule_vars.scheduleBuf[i].channelOffset;
@@ -613,4 +738,263 @@ void schedule_resetEntry(scheduleEntry_t* pScheduleEntry) {
    pScheduleEntry->lastUsedAsn.bytes0and1   = 0;
    pScheduleEntry->lastUsedAsn.bytes2and3   = 0;
    pScheduleEntry->lastUsedAsn.byte4        = 0;
+   pScheduleEntry->backoff.backoffExponent  = MINBE-1;
+   pScheduleEntry->backoff.backoff          = 0;
+}
+
+/**
+\brief Remove consecutive rows from the schedule.
+
+The following rows move up, and currentEntry keeps pointing to the same cell
+if it was not removed.
+
+\pre Called with interrupts disabled.
+
+\param first The first row to remove.
+\param last  The row after the last one to remove.
+*/
+void schedule_removeRows(uint8_t first, uint8_t last) {
+   uint8_t i;
+   
+   if (first>=last) {
+      return;
+   }
+   memmove(
+      &schedule_vars.scheduleBuf[first],
+      &schedule_vars.scheduleBuf[last],
+      (schedule_vars.numActiveSlots-last)*sizeof(scheduleEntry_t)
+   );
+   for (i=schedule_vars.numActiveSlots-(last-first);i<schedule_vars.numActiveSlots;i++) {
+      schedule_resetEntry(&schedule_vars.scheduleBuf[i]);
+   }
+   schedule_vars.numActiveSlots   -= last-first;
+   schedule_dbg.numActiveSlotsCur -= last-first;
+   if (schedule_vars.currentEntry>=last) {
+      schedule_vars.currentEntry  -= last-first;
+   } else if (
+         schedule_vars.currentEntry>=first ||
+         schedule_vars.currentEntry>=schedule_vars.numActiveSlots
+      ) {
+      schedule_vars.currentEntry   = 0;
+   }
+}
+
+/**
+\brief Find the backoff state which applies to the current cell.
+
+\param neighbor The next hop of the packet sent in the current cell.
+\param create   In a shared anycast cell, whether to start tracking that
+   neighbor if it is not yet. The row of the neighbor with the smallest backoff
+   exponent is reused; rows of neighbors not backing off come first.
+
+\returns The backoff state of the current cell, or of that neighbor in an
+   anycast cell. NULL if the cell is not shared, or if the neighbor is not
+   backing off and create is FALSE.
+*/
+backoff_t* schedule_getBackoff(open_addr_t* neighbor, bool create) {
+   scheduleEntry_t* current;
+   nbrBackoff_t*    row;
+   nbrBackoff_t*    candidate;
+   uint8_t          i;
+   
+   current = &schedule_vars.scheduleBuf[schedule_vars.currentEntry];
+   if (current->shared==FALSE) {
+      return NULL;
+   }
+   if (current->neighbor.type!=ADDR_ANYCAST) {
+      return &current->backoff;
+   }
+   
+   candidate = NULL;
+   for (i=0;i<NUMNBRBACKOFF;i++) {
+      row = &schedule_vars.nbrBackoff[i];
+      if (row->neighbor.type!=ADDR_NONE && packetfunctions_sameAddress(neighbor,&row->neighbor)) {
+         return &row->backoff;
+      }
+      if (candidate==NULL || row->backoff.backoffExponent<candidate->backoff.backoffExponent) {
+         candidate = row;
+      }
+   }
+   if (create==FALSE) {
+      return NULL;
+   }
+   memcpy(&candidate->neighbor,neighbor,sizeof(open_addr_t));
+   candidate->backoff.backoffExponent = MINBE-1;
+   candidate->backoff.backoff         = 0;
+   return &candidate->backoff;
+}
+
+/**
+\brief Find the first row of the schedule at or after some cell position.
+
+Binary search over scheduleBuf, sorted by slotframe handle, then slot offset.
+
+\param slotframeHandle The slotframe to look in.
+\param slotOffset      The slot offset to look for.
+
+\returns The index of the first row not before (slotframeHandle,slotOffset),
+   or numActiveSlots if there is none.
+*/
+uint8_t schedule_lowerBound(uint8_t slotframeHandle, slotOffset_t slotOffset) {
+   scheduleEntry_t* entry;
+   uint8_t          low;
+   uint8_t          high;
+   uint8_t          mid;
+   
+   low  = 0;
+   high = schedule_vars.numActiveSlots;
+   while (low<high) {
+      mid   = low+(high-low)/2;
+      entry = &schedule_vars.scheduleBuf[mid];
+      if (
+            entry->slotframeHandle<slotframeHandle ||
+            (entry->slotframeHandle==slotframeHandle && entry->slotOffset<slotOffset)
+         ) {
+         low  = mid+1;
+      } else {
+         high = mid;
+      }
+   }
+   return low;
+}
+
+/**
+\brief Find the schedule row of a cell.
+
+\param slotframeHandle The slotframe of the cell.
+\param slotOffset      The slot offset of the cell.
+\param neighbor        The neighbor of the cell.
+
+\returns A pointer to the row, or NULL if that cell is not scheduled.
+*/
+scheduleEntry_t* schedule_findEntry(uint8_t slotframeHandle, slotOffset_t slotOffset, open_addr_t* neighbor) {
+   scheduleEntry_t* entry;
+   uint8_t          i;
+   
+   if (schedule_isActiveSlot(slotframeHandle,slotOffset)==FALSE) {
+      return NULL;
+   }
+   for (i=schedule_lowerBound(slotframeHandle,slotOffset);i<schedule_vars.numActiveSlots;i++) {
+      entry = &schedule_vars.scheduleBuf[i];
+      if (entry->slotframeHandle!=slotframeHandle || entry->slotOffset!=slotOffset) {
+         break;
+      }
+      if (packetfunctions_sameAddress(neighbor,&(entry->neighbor))) {
+         return entry;
+      }
+   }
+   return NULL;
+}
+
+/**
+\brief Check in the bitmap whether a cell is scheduled at some slot offset of
+a slotframe.
+*/
+port_INLINE bool schedule_isActiveSlot(uint8_t slotframeHandle, slotOffset_t slotOffset) {
+   if (slotframeHandle>=MAXSLOTFRAMES || slotOffset>=MAXFRAMELENGTH) {
+      return FALSE;
+   }
+   return (schedule_vars.slotframes[slotframeHandle].activeSlotBitmap[slotOffset/8] & (1<<(slotOffset%8)))!=0;
+}
+
+/**
+\brief Clear the bitmap bit of a slot offset if no cell is left there.
+*/
+void schedule_updateBitmap(uint8_t slotframeHandle, slotOffset_t slotOffset) {
+   scheduleEntry_t* entry;
+   uint8_t          i;
+   
+   i     = schedule_lowerBound(slotframeHandle,slotOffset);
+   entry = &schedule_vars.scheduleBuf[i];
+   if (
+         i==schedule_vars.numActiveSlots              ||
+         entry->slotframeHandle!=slotframeHandle      ||
+         entry->slotOffset!=slotOffset
+      ) {
+      schedule_vars.slotframes[slotframeHandle].activeSlotBitmap[slotOffset/8] &= ~(1<<(slotOffset%8));
+   }
+}
+
+/**
+\brief Pick the cell of the current slot.
+
+Several cells can be scheduled in the same slot, in one or several slotframes
+(e.g. the cells of different neighbors, or of a bundle of cells towards the same
+neighbor). Like in IEEE802.15.4e, the cell used is, in that order:
+- the first cell which has a packet to transmit;
+- else, the first cell in which the mote can receive;
+- else, the first cell.
+Cells are considered by increasing slotframe handle, then in the order they
+were added.
+
+\returns TRUE if a cell is scheduled in the current slot, FALSE otherwise.
+*/
+bool schedule_findCurrent() {
+   slotframe_t*     slotframe;
+   scheduleEntry_t* entry;
+   uint8_t          handle;
+   uint8_t          i;
+   bool             found;
+   
+   found = FALSE;
+   for (handle=0;handle<MAXSLOTFRAMES;handle++) {
+      slotframe = &schedule_vars.slotframes[handle];
+      if (slotframe->frameLength==0 || schedule_isActiveSlot(handle,slotframe->slotOffset)==FALSE) {
+         continue;
+      }
+      for (i=schedule_lowerBound(handle,slotframe->slotOffset);i<schedule_vars.numActiveSlots;i++) {
+         entry = &schedule_vars.scheduleBuf[i];
+         if (entry->slotframeHandle!=handle || entry->slotOffset!=slotframe->slotOffset) {
+            break;
+         }
+         if (schedule_hasTraffic(entry)) {
+            // transmitting takes precedence
+            schedule_vars.currentEntry = i;
+            return TRUE;
+         }
+         if (
+               found==FALSE ||
+               (
+                  schedule_vars.scheduleBuf[schedule_vars.currentEntry].type==CELLTYPE_TX &&
+                  entry->type!=CELLTYPE_TX
+               )
+            ) {
+            // first cell, or first cell the mote can receive in
+            schedule_vars.currentEntry = i;
+            found = TRUE;
+         }
+      }
+   }
+   return found;
+}
+
+/**
+\brief Check whether a packet is waiting in the queue for a cell.
+
+\param entry The cell.
+
+\returns TRUE if the MAC would transmit in that cell, FALSE otherwise.
+*/
+bool schedule_hasTraffic(scheduleEntry_t* entry) {
+   switch (entry->type) {
+      case CELLTYPE_ADV:
+         return openqueue_macGetAdvPacket()!=NULL;
+      case CELLTYPE_TX:
+      case CELLTYPE_TXRX:
+         return openqueue_macGetDataPacket(&entry->neighbor)!=NULL;
+      default:
+         return FALSE;
+   }
+}
+
+/**
+\brief Compute ASN%frameLength, 16 bits of the ASN at a time.
+*/
+slotOffset_t schedule_asnModulo(asn_t* asn, frameLength_t frameLength) {
+   uint32_t res;
+   
+   res = asn->byte4%frameLength;
+   res = ((res<<16)+asn->bytes2and3)%frameLength;
+   res = ((res<<16)+asn->bytes0and1)%frameLength;
+   return (slotOffset_t)res;
 }
@@ -28,12 +28,50 @@ The superframe repears over time and can be arbitrarly long.
 
 Note that this is merely used to allocate RAM memory for the schedule. The
 schedule is represented, in RAM, by a table. There is one row per active slot
-in that table; a slot is "active" when it is not of type CELLTYPE_OFF.
+in that table; a slot is "active" when it is not of type CELLTYPE_OFF. The rows
+are kept sorted by slot offset.
 
 Set this number to the exact number of active slots you are planning on having
-in your schedule, so not to waste RAM.
+in your schedule, so not to waste RAM. It can be overwritten at compile time,
+up to 255. Only the first #MAXNETDEBUGSLOTS rows are reported by layerdebug.
 */
+#ifndef MAXACTIVESLOTS
 #define MAXACTIVESLOTS       (NUMADVSLOTS+NUMSHAREDTXRX+NUMSERIALRX)
+#endif
+
+/**
+\brief Maximum number of rows schedule_getNetDebugInfo() reports.
+
+layerdebug sends them in a single CoAP packet, so they need to fit in a frame
+next to the headers.
+*/
+#if MAXACTIVESLOTS<16
+#define MAXNETDEBUGSLOTS     MAXACTIVESLOTS
+#else
+#define MAXNETDEBUGSLOTS     16
+#endif
+
+/**
+\brief Maximum length of the superframe, in slots.
+
+Sizes the bitmap of active slot offsets. No cell can be added at a larger slot
+offset.
+*/
+#define MAXFRAMELENGTH       128
+
+/**
+\brief Maximum number of slotframes running at the same time.
+
+Each slotframe has its own length and cells, and repeats independently of the
+others. When cells of several slotframes fall in the same slot, the cell of the
+slotframe with the lowest handle is used. Slotframe #SLOTFRAME_DEFAULT holds
+the schedule built at boot.
+*/
+#ifndef MAXSLOTFRAMES
+#define MAXSLOTFRAMES        2
+#endif
+
+#define SLOTFRAME_DEFAULT    0
 
 /**
 \brief Minimum backoff exponent.
@@ -51,6 +89,16 @@ See MINBE for an explanation of backoff.
 */
 #define MAXBE                4
 
+/**
+\brief Number of neighbors whose backoff is tracked in shared anycast cells.
+
+A shared cell to a given neighbor keeps its own backoff. A shared anycast cell
+carries packets to any neighbor, so its backoff is kept per destination
+neighbor instead, in a table of this size. Rows of neighbors not backing off
+are reused first.
+*/
+#define NUMNBRBACKOFF        4
+
 //=========================== typedef =========================================
 
 typedef uint8_t    channelOffset_t;
@@ -69,6 +117,14 @@ typedef enum {
 
 PRAGMA(pack(1));
 typedef struct {
+   uint8_t         backoffExponent;
+   uint8_t         backoff;              // number of opportunities to skip before transmitting
+} backoff_t;
+PRAGMA(pack());
+
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t         slotframeHandle;
    slotOffset_t    slotOffset;
    cellType_t      type;
    bool            shared;
@@ -78,10 +134,25 @@ typedef struct {
    uint8_t         numTx;
    uint8_t         numTxACK;
    asn_t           lastUsedAsn;
-   void*           next;
+   backoff_t       backoff;              // used if shared, to a given neighbor
 } scheduleEntry_t;
 PRAGMA(pack());
 
+typedef struct {
+   open_addr_t     neighbor;             // ADDR_NONE if this row was never used
+   backoff_t       backoff;
+} nbrBackoff_t;
+
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t         backoffExponent;      // largest backoff exponent in use
+   uint8_t         backoff;              // largest backoff counter
+   uint8_t         numBackingOff;        // cells and neighbors currently backing off
+   uint16_t        numTxDeferred;        // transmissions deferred because of backoff
+   uint16_t        numSharedTxFail;      // failed transmissions in shared cells
+} debugBackoff_t;
+PRAGMA(pack());
+
 //used to debug through ipv6 pkt. 
 
 PRAGMA(pack(1));
@@ -116,14 +187,22 @@ typedef struct {
   channelOffset_t channelOffset;
 }slotinfo_element_t;
 PRAGMA(pack());
+
+typedef struct {
+   frameLength_t   frameLength;          // 0 when this slotframe is not in use
+   slotOffset_t    slotOffset;           // slot offset of the current slot in this slotframe
+   uint8_t         activeSlotBitmap[(MAXFRAMELENGTH+7)/8]; // bit set iff a cell is at that slotOffset
+} slotframe_t;
+
 //=========================== variables =======================================
 
 typedef struct {
-   scheduleEntry_t  scheduleBuf[MAXACTIVESLOTS];
-   scheduleEntry_t* currentScheduleEntry;
-   uint16_t         frameLength;
-   uint8_t          backoffExponent;
-   uint8_t          backoff;
+   scheduleEntry_t  scheduleBuf[MAXACTIVESLOTS]; // active slots, sorted by slotframeHandle, then slotOffset
+   uint8_t          numActiveSlots;       // number of rows used in scheduleBuf
+   uint8_t          currentEntry;         // row of the cell used in the current slot
+   slotframe_t      slotframes[MAXSLOTFRAMES];
+   asn_t            lastAsn;              // ASN the slotframe slot offsets correspond to
+   nbrBackoff_t     nbrBackoff[NUMNBRBACKOFF]; // backoff in shared anycast cells, per neighbor
    slotOffset_t     debugPrintRow;
 } schedule_vars_t;
 
@@ -131,6 +210,8 @@ typedef struct {
    uint8_t          numActiveSlotsCur;
    uint8_t          numActiveSlotsMax;
    uint8_t          numUpdatedSlotsCur;
+   uint16_t         numTxDeferred;
+   uint16_t         numSharedTxFail;
 } schedule_dbg_t;
 
 //=========================== prototypes ======================================
@@ -141,7 +222,9 @@ bool               debugPrint_schedule();
 bool               debugPrint_backoff();
 // from uRES
 void               schedule_setFrameLength(frameLength_t newFrameLength);
+owerror_t          schedule_setSlotframe(uint8_t slotframeHandle, frameLength_t frameLength);
 owerror_t            schedule_addActiveSlot(
+                        uint8_t        slotframeHandle,
                         slotOffset_t   slotOffset,
                         cellType_t     type,
                         bool           shared,
@@ -149,28 +232,31 @@ owerror_t            schedule_addActiveSlot(
                         open_addr_t*   neighbor,
                         bool isUpdate);
 
-void               schedule_getSlotInfo(slotOffset_t   slotOffset,                      
+void               schedule_getSlotInfo(uint8_t slotframeHandle,
+                              slotOffset_t   slotOffset,                      
                               open_addr_t*   neighbor,
                               slotinfo_element_t* info);
 
-owerror_t               schedule_removeActiveSlot(slotOffset_t   slotOffset,                      
+owerror_t               schedule_removeActiveSlot(uint8_t slotframeHandle,
+                              slotOffset_t   slotOffset,                      
                               open_addr_t*   neighbor);
 
 
 // from IEEE802154E
-void               schedule_syncSlotOffset(slotOffset_t targetSlotOffset);
-void               schedule_advanceSlot();
-slotOffset_t       schedule_getNextActiveSlotOffset();
+void               schedule_syncAsn(asn_t* asn);
+bool               schedule_advanceSlot(asn_t* asn);
+bool               schedule_isNextSlotActive();
 frameLength_t      schedule_getFrameLength();
 cellType_t         schedule_getType();
 void               schedule_getNeighbor(open_addr_t* addrToWrite);
 channelOffset_t    schedule_getChannelOffset();
-bool               schedule_getOkToSend();
+bool               schedule_getOkToSend(open_addr_t* neighbor);
 void               schedule_resetBackoff();
 void               schedule_indicateRx(asn_t*   asnTimestamp);
 void               schedule_indicateTx(
-                        asn_t*    asnTimestamp,
-                        bool      succesfullTx
+                        asn_t*       asnTimestamp,
+                        bool         succesfullTx,
+                        open_addr_t* neighbor
                    );
 void               schedule_getNetDebugInfo(netDebugScheduleEntry_t* schlist);
 
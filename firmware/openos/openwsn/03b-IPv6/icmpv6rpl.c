@@ -18,11 +18,9 @@ icmpv6rpl_vars_t             icmpv6rpl_vars;
 //=========================== prototypes ======================================
 
 // DIO-related
-void icmpv6rpl_timer_DIO_cb();
 void icmpv6rpl_timer_DIO_task();
 void sendDIO();
 // DAO-related
-void icmpv6rpl_timer_DAO_cb();
 void icmpv6rpl_timer_DAO_task();
 void sendDAO();
 
@@ -62,11 +60,13 @@ void icmpv6rpl_init() {
    memcpy(&icmpv6rpl_vars.dioDestination.addr_128b[0],all_routers_multicast,sizeof(all_routers_multicast));
    
    icmpv6rpl_vars.periodDIO                 = TIMER_DIO_TIMEOUT+(openrandom_get16b()&0xff);
-   icmpv6rpl_vars.timerIdDIO                = opentimers_start(
+   icmpv6rpl_vars.timerIdDIO                = opentimers_startTask(
                                                 icmpv6rpl_vars.periodDIO,
+                                                0,
                                                 TIMER_PERIODIC,
                                                 TIME_MS,
-                                                icmpv6rpl_timer_DIO_cb
+                                                icmpv6rpl_timer_DIO_task,
+                                                TASKPRIO_RPL
                                              );
    
    //=== DAO-related
@@ -105,11 +105,13 @@ void icmpv6rpl_init() {
    icmpv6rpl_vars.dao_target.prefixLength = 0;
    
    icmpv6rpl_vars.periodDAO                 = TIMER_DAO_TIMEOUT+(openrandom_get16b()&0xff);
-   icmpv6rpl_vars.timerIdDAO                = opentimers_start(
+   icmpv6rpl_vars.timerIdDAO                = opentimers_startTask(
                                                 icmpv6rpl_vars.periodDAO,
+                                                0,
                                                 TIMER_PERIODIC,
                                                 TIME_MS,
-                                                icmpv6rpl_timer_DAO_cb
+                                                icmpv6rpl_timer_DAO_task,
+                                                TASKPRIO_RPL
                                              );
    
 }
@@ -219,16 +221,6 @@ void icmpv6rpl_receive(OpenQueueEntry_t* msg) {
 
 //===== DIO-related
 
-/**
-\brief DIO timer callback function.
-
-\note This function is executed in interrupt context, and should only push a 
-   task.
-*/
-void icmpv6rpl_timer_DIO_cb() {
-   scheduler_push_task(icmpv6rpl_timer_DIO_task,TASKPRIO_RPL);
-}
-
 /**
 \brief Handler for DIO timer event.
 
@@ -345,16 +337,6 @@ void sendDIO() {
 
 //===== DAO-related
 
-/**
-\brief DAO timer callback function.
-
-\note This function is executed in interrupt context, and should only push a
-   task.
-*/
-void icmpv6rpl_timer_DAO_cb() {
-   scheduler_push_task(icmpv6rpl_timer_DAO_task,TASKPRIO_RPL);
-}
-
 /**
 \brief Handler for DAO timer event.
 
@@ -15,7 +15,7 @@ opencoap_vars_t opencoap_vars;
 
 //=========================== prototype =======================================
 
-void icmpv6coap_timer_cb();
+void timers_coap_fired();
 
 //=========================== public ==========================================
 
@@ -30,9 +30,11 @@ void opencoap_init() {
    
    // start the timer
    if (idmanager_getIsDAGroot()==FALSE) {
-      opencoap_vars.timerId = opentimers_start(1000,
-                                               TIMER_PERIODIC,TIME_MS,
-                                               icmpv6coap_timer_cb);
+      opencoap_vars.timerId = opentimers_startTask(1000,
+                                                   100,
+                                                   TIMER_PERIODIC,TIME_MS,
+                                                   timers_coap_fired,
+                                                   TASKPRIO_COAP);
    }
 }
 
@@ -351,8 +353,4 @@ owerror_t opencoap_send(OpenQueueEntry_t*     msg,
    return openudp_send(msg);
 }
 
-//=========================== private =========================================
-
-void icmpv6coap_timer_cb() {
-   scheduler_push_task(timers_coap_fired,TASKPRIO_COAP);
-}
\ No newline at end of file
+//=========================== private =========================================
\ No newline at end of file
@@ -23,7 +23,7 @@ void prependTCPHeader(OpenQueueEntry_t* msg, bool ack, bool push, bool rst, bool
 bool containsControlBits(OpenQueueEntry_t* msg, uint8_t ack, uint8_t rst, uint8_t syn, uint8_t fin);
 void tcp_change_state(uint8_t new_state);
 void opentcp_reset();
-void opentcp_timer_cb();
+void timers_tcp_fired();
 
 //=========================== public ==========================================
 
@@ -733,15 +733,13 @@ void tcp_change_state(uint8_t new_tcp_state) {
       }
    } else {
       if (tcp_vars.timerStarted==FALSE) {
-         tcp_vars.timerId = opentimers_start(TCP_TIMEOUT,
-                                             TIMER_ONESHOT,TIME_MS,
-                                             opentcp_timer_cb);
+         tcp_vars.timerId = opentimers_startTask(TCP_TIMEOUT,
+                                                 0,
+                                                 TIMER_ONESHOT,TIME_MS,
+                                                 timers_tcp_fired,
+                                                 TASKPRIO_TCP_TIMEOUT);
          tcp_vars.timerStarted=TRUE;
       }
       
    }
-}
-
-void opentcp_timer_cb() {
-   scheduler_push_task(timers_tcp_fired,TASKPRIO_TCP_TIMEOUT);
 }
\ No newline at end of file
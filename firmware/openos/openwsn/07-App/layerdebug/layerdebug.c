@@ -17,6 +17,8 @@
 /// inter-packet period (in ms)
 #define DEBUGPERIODNBS    11000
 #define DEBUGPERIODSCH    7000
+/// how late the timers may fire (in ms), to share a wakeup with others
+#define DEBUGSLACK        1000
 
 const uint8_t schedule_layerdebug_path0[]  = "d_s"; // debug/scheduling
 const uint8_t neighbors_layerdebug_path0[] = "d_n"; // debug/neighbours
@@ -43,9 +45,6 @@ owerror_t layerdebug_neighbors_receive(OpenQueueEntry_t* msg,
                     coap_header_iht*  coap_header,
                     coap_option_iht*  coap_options);
 
-void    layerdebug_timer_schedule_cb();
-void    layerdebug_timer_neighbors_cb();
-
 void    layerdebug_task_schedule_cb();
 void    layerdebug_task_neighbors_cb();
 
@@ -66,9 +65,11 @@ void layerdebug_init() {
    layerdebug_vars.schdesc.callbackSendDone     = &layerdebug_sendDone;
    opencoap_register(&layerdebug_vars.schdesc);
     
-   layerdebug_vars.schtimerId     = opentimers_start(DEBUGPERIODSCH,
-                                                     TIMER_PERIODIC,TIME_MS,
-                                                     layerdebug_timer_schedule_cb);
+   layerdebug_vars.schtimerId     = opentimers_startTask(DEBUGPERIODSCH,
+                                                         DEBUGSLACK,
+                                                         TIMER_PERIODIC,TIME_MS,
+                                                         layerdebug_task_schedule_cb,
+                                                         TASKPRIO_COAP);
    
    // prepare the resource descriptor for the neighbors path
    layerdebug_vars.nbsdesc.path0len             = sizeof(schedule_layerdebug_path0)-1;
@@ -80,23 +81,15 @@ void layerdebug_init() {
    layerdebug_vars.nbsdesc.callbackSendDone     = &layerdebug_sendDone;
    opencoap_register(&layerdebug_vars.nbsdesc);
    
-   layerdebug_vars.nbstimerId     = opentimers_start(DEBUGPERIODNBS,
-                                                     TIMER_PERIODIC,TIME_MS,
-                                                     layerdebug_timer_neighbors_cb);
+   layerdebug_vars.nbstimerId     = opentimers_startTask(DEBUGPERIODNBS,
+                                                         DEBUGSLACK,
+                                                         TIMER_PERIODIC,TIME_MS,
+                                                         layerdebug_task_neighbors_cb,
+                                                         TASKPRIO_COAP);
 }
 
 //=========================== private =========================================
 
-//timer fired, but we don't want to execute task in ISR mode
-//instead, push task to scheduler with COAP priority, and let scheduler take care of it
-void layerdebug_timer_schedule_cb(){
-   scheduler_push_task(layerdebug_task_schedule_cb,TASKPRIO_COAP);
-}
-
-void layerdebug_timer_neighbors_cb(){
-   scheduler_push_task(layerdebug_task_neighbors_cb,TASKPRIO_COAP);
-}
-
 //schedule stats
 void layerdebug_task_schedule_cb() {
    OpenQueueEntry_t* pkt;
@@ -117,13 +110,13 @@ void layerdebug_task_schedule_cb() {
    pkt->creator    = COMPONENT_LAYERDEBUG;
    pkt->owner      = COMPONENT_LAYERDEBUG;
    // CoAP payload
-   size=sizeof(netDebugScheduleEntry_t)*MAXACTIVESLOTS;
+   size=sizeof(netDebugScheduleEntry_t)*MAXNETDEBUGSLOTS;
    packetfunctions_reserveHeaderSize(pkt,size);//reserve for some schedule entries
    //get the schedule information from the mac layer 
    schedule_getNetDebugInfo((netDebugScheduleEntry_t*)pkt->payload);
    
    packetfunctions_reserveHeaderSize(pkt,1);//reserve for the size of schedule entries
-   pkt->payload[0] = MAXACTIVESLOTS;
+   pkt->payload[0] = MAXNETDEBUGSLOTS;
   
    
    numOptions = 0;
@@ -241,13 +234,13 @@ owerror_t layerdebug_schedule_receive(OpenQueueEntry_t* msg,
       msg->payload                     = &(msg->packet[127]);
       msg->length                      = 0;
            
-      size=sizeof(netDebugScheduleEntry_t)*MAXACTIVESLOTS;
+      size=sizeof(netDebugScheduleEntry_t)*MAXNETDEBUGSLOTS;
       packetfunctions_reserveHeaderSize(msg,size);//reserve for some schedule entries
       //get the schedule information from the mac layer 
       schedule_getNetDebugInfo((netDebugScheduleEntry_t*)msg->payload);
 
       packetfunctions_reserveHeaderSize(msg,1);//reserve for the size of schedule entries
-      msg->payload[0] = MAXACTIVESLOTS;
+      msg->payload[0] = MAXNETDEBUGSLOTS;
            
       // set the CoAP header
       coap_header->Code                = COAP_CODE_RESP_CONTENT;
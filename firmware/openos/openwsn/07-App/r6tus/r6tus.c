@@ -100,13 +100,13 @@ owerror_t r6tus_receive(OpenQueueEntry_t* msg,
             case ADDR_16B:
                temp_addr.type=ADDR_16B;
                memcpy(&(temp_addr.addr_16b[0]), &(coap_options[3].pValue[0]),LENGTH_ADDR16b);
-               schedule_getSlotInfo(getLink_elementResponse.slotOffset, &temp_addr, &getLink_elementResponse);
+               schedule_getSlotInfo(SLOTFRAME_DEFAULT,getLink_elementResponse.slotOffset, &temp_addr, &getLink_elementResponse);
                outcome                 = E_SUCCESS;
                break;
             case ADDR_64B:
                temp_addr.type=ADDR_64B;
                memcpy(&(temp_addr.addr_64b[0]), &(coap_options[3].pValue[0]),LENGTH_ADDR64b);
-               schedule_getSlotInfo(getLink_elementResponse.slotOffset, &temp_addr, &getLink_elementResponse);
+               schedule_getSlotInfo(SLOTFRAME_DEFAULT,getLink_elementResponse.slotOffset, &temp_addr, &getLink_elementResponse);
                outcome                 = E_SUCCESS;
                break;
             case ADDR_128B:
@@ -143,7 +143,7 @@ owerror_t r6tus_receive(OpenQueueEntry_t* msg,
                   link_element=(slotinfo_element_t*) &(msg->payload[sizeof(r6tus_command_t)+i*sizeof(slotinfo_element_t)]);
                   temp_addr.type=ADDR_64B;
                   memcpy(&(temp_addr.addr_64b[0]), &(link_element->address[0]),LENGTH_ADDR64b);
-                  responses[i]=schedule_addActiveSlot(link_element->slotOffset,link_element->link_type,link_element->shared,link_element->channelOffset,&temp_addr,(link_command->type==UPDATE_LINK));
+                  responses[i]=schedule_addActiveSlot(SLOTFRAME_DEFAULT,link_element->slotOffset,link_element->link_type,link_element->shared,link_element->channelOffset,&temp_addr,(link_command->type==UPDATE_LINK));
                }
                outcome=E_SUCCESS; 
             }
@@ -187,7 +187,7 @@ owerror_t r6tus_receive(OpenQueueEntry_t* msg,
                   temp_addr.type=ADDR_64B;
                   memcpy(&(temp_addr.addr_64b[0]), &(link_element->address[0]),LENGTH_ADDR64b);
                   //remove the required links.
-                  responses[i]=schedule_removeActiveSlot(link_element->slotOffset,&temp_addr);
+                  responses[i]=schedule_removeActiveSlot(SLOTFRAME_DEFAULT,link_element->slotOffset,&temp_addr);
                }
                outcome=E_SUCCESS; 
             }
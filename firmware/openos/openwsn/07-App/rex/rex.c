@@ -13,6 +13,8 @@
 
 /// inter-packet period (in ms)
 #define REXPERIOD    10000
+/// how late the timer may fire (in ms), to share a wakeup with others
+#define REXSLACK     1000
 #define PAYLOADLEN    62
 
 const uint8_t rex_path0[] = "rex";
@@ -31,7 +33,6 @@ rex_vars_t rex_vars;
 owerror_t rex_receive(OpenQueueEntry_t* msg,
                     coap_header_iht*  coap_header,
                     coap_option_iht*  coap_options);
-void    rex_timer_cb();
 void    rex_task_cb();
 void    rex_sendDone(OpenQueueEntry_t* msg,
                        owerror_t error);
@@ -51,9 +52,11 @@ void rex_init() {
    
    
    opencoap_register(&rex_vars.desc);
-   rex_vars.timerId    = opentimers_start(REXPERIOD,
-                                                TIMER_PERIODIC,TIME_MS,
-                                                rex_timer_cb);
+   rex_vars.timerId    = opentimers_startTask(REXPERIOD,
+                                              REXSLACK,
+                                              TIMER_PERIODIC,TIME_MS,
+                                              rex_task_cb,
+                                              TASKPRIO_COAP);
 }
 
 //=========================== private =========================================
@@ -64,12 +67,6 @@ owerror_t rex_receive(OpenQueueEntry_t* msg,
    return E_FAIL;
 }
 
-//timer fired, but we don't want to execute task in ISR mode
-//instead, push task to scheduler with COAP priority, and let scheduler take care of it
-void rex_timer_cb(){
-   scheduler_push_task(rex_task_cb,TASKPRIO_COAP);
-}
-
 void rex_task_cb() {
    OpenQueueEntry_t* pkt;
    owerror_t           outcome;
@@ -12,6 +12,7 @@
 //=========================== variables =======================================
 
 #define RREGPERIOD       30000
+#define RREGSLACK        3000
 
 typedef struct {
    coap_resource_desc_t desc;
@@ -51,9 +52,10 @@ void rreg_init() {
    
    opencoap_register(&rreg_vars.desc);
    // register to the RD server every 30s
-   rreg_vars.timerId    = opentimers_start(RREGPERIOD,
-                                          TIMER_PERIODIC,TIME_MS,
-                                          rreg_timer);
+   rreg_vars.timerId    = opentimers_startWithSlack(RREGPERIOD,
+                                                     RREGSLACK,
+                                                     TIMER_PERIODIC,TIME_MS,
+                                                     rreg_timer);
 }
 
 //=========================== private =========================================
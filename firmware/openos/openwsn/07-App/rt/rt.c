@@ -13,6 +13,8 @@
 
 /// inter-packet period (in mseconds)
 #define RTPERIOD     20000
+/// how late the timer may fire, as a fraction of its period, to share a wakeup with others
+#define RTSLACKDIV   8
 
 const uint8_t rt_path0[] = "t";
 
@@ -37,6 +39,8 @@ void    rt_sendDone(OpenQueueEntry_t* msg,
 //=========================== public ==========================================
 
 void rt_init() {
+   uint16_t period;
+   
    // startup the sensor
    sensitive_accel_temperature_init();
    
@@ -50,9 +54,11 @@ void rt_init() {
    rt_vars.desc.callbackSendDone     = &rt_sendDone;
    
 
-   rt_vars.timerId    = opentimers_start(openrandom_get16b()%RTPERIOD,
-                                          TIMER_PERIODIC,TIME_MS,
-                                          rt_timer);
+   period             = openrandom_get16b()%RTPERIOD;
+   rt_vars.timerId    = opentimers_startWithSlack(period,
+                                                   period/RTSLACKDIV,
+                                                   TIMER_PERIODIC,TIME_MS,
+                                                   rt_timer);
    opencoap_register(&rt_vars.desc);
 }
 
@@ -13,6 +13,8 @@
 
 /// inter-packet period (in mseconds)
 #define RXL1PERIOD     6000
+/// how late the timer may fire, as a fraction of its period, to share a wakeup with others
+#define RXL1SLACKDIV   8
 
 const uint8_t rxl1_path0[] = "x";
 
@@ -37,6 +39,8 @@ void    rxl1_sendDone(OpenQueueEntry_t* msg,
 //=========================== public ==========================================
 
 void rxl1_init() {
+   uint16_t period;
+   
    // startup the sensor
    sensitive_accel_temperature_init();
    
@@ -50,9 +54,11 @@ void rxl1_init() {
    rxl1_vars.desc.callbackSendDone     = &rxl1_sendDone;
    
    //we start a timer, but just to get a timer ID, we stop it immediately
-   rxl1_vars.timerId    = opentimers_start(openrandom_get16b()%RXL1PERIOD,
-                                          TIMER_PERIODIC,TIME_MS,
-                                          rxl1_timer);
+   period               = openrandom_get16b()%RXL1PERIOD;
+   rxl1_vars.timerId    = opentimers_startWithSlack(period,
+                                                     period/RXL1SLACKDIV,
+                                                     TIMER_PERIODIC,TIME_MS,
+                                                     rxl1_timer);
    opentimers_stop(rxl1_vars.timerId);
    
    opencoap_register(&rxl1_vars.desc);
@@ -27,7 +27,6 @@ udplatency_vars_t udplatency_vars;
 
 //=========================== prototypes ======================================
 
-void udplatency_timer();
 
 //=========================== public ==========================================
 
@@ -35,9 +34,11 @@ void udplatency_init() {
  //don't run on dagroot 
  if (idmanager_getIsDAGroot()) return;
  
- udplatency_vars.timerId    = opentimers_start(UDPLATENCYPERIOD,
-                                          TIMER_PERIODIC,TIME_MS,
-                                          udplatency_timer);
+ udplatency_vars.timerId    = opentimers_startTask(UDPLATENCYPERIOD,
+                                              0,
+                                              TIMER_PERIODIC,TIME_MS,
+                                              udplatency_task,
+                                              TASKPRIO_COAP);
 }
 
 void udplatency_task(){
@@ -96,10 +97,6 @@ void udplatency_task(){
    }
 }
 
-void udplatency_timer() {
-  scheduler_push_task(udplatency_task,TASKPRIO_COAP);
-}
-
 void udplatency_sendDone(OpenQueueEntry_t* msg, owerror_t error) {
    msg->owner = COMPONENT_UDPLATENCY;
    if (msg->creator!=COMPONENT_UDPLATENCY) {
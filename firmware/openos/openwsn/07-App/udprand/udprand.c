@@ -13,6 +13,8 @@
 
 /// inter-packet period (in mseconds)
 #define UDPRANDPERIOD     30000
+/// how late the timer may fire, as a fraction of its period, to share a wakeup with others
+#define UDPRANDSLACKDIV   8
 
 //=========================== variables =======================================
 
@@ -24,14 +26,18 @@ udprand_vars_t udprand_vars;
 
 //=========================== prototypes ======================================
 
-void udprand_timer();
 
 //=========================== public ==========================================
 
 void udprand_init() {
-   udprand_vars.timerId    = opentimers_start(openrandom_get16b()%UDPRANDPERIOD,
-                                          TIMER_PERIODIC,TIME_MS,
-                                          udprand_timer);
+   uint16_t period;
+   
+   period                  = openrandom_get16b()%UDPRANDPERIOD;
+   udprand_vars.timerId    = opentimers_startTask(period,
+                                                   period/UDPRANDSLACKDIV,
+                                                   TIMER_PERIODIC,TIME_MS,
+                                                   udprand_task,
+                                                   TASKPRIO_COAP);
 }
 
 void udprand_task(){
@@ -60,10 +66,6 @@ void udprand_task(){
    }
 }
 
-void udprand_timer() {
-  scheduler_push_task(udprand_task,TASKPRIO_COAP);
-}
-
 void udprand_sendDone(OpenQueueEntry_t* msg, owerror_t error) {
    msg->owner = COMPONENT_UDPRAND;
    if (msg->creator!=COMPONENT_UDPRAND) {
@@ -39,7 +39,6 @@ udpstorm_vars_t udpstorm_vars;
 owerror_t udpstorm_receive(OpenQueueEntry_t* msg,
                          coap_header_iht*  coap_header,
                          coap_option_iht*  coap_options);
-void    udpstorm_timer_cb();
 void    udpstorm_task_cb();
 void    udpstorm_sendDone(OpenQueueEntry_t* msg,
                           owerror_t           error);
@@ -57,9 +56,11 @@ void udpstorm_init() {
    udpstorm_vars.desc.callbackSendDone     = &udpstorm_sendDone;
    
    opencoap_register(&udpstorm_vars.desc);
-   udpstorm_vars.timerId     = opentimers_start(UDPSTORMPERIOD,
-                                                TIMER_PERIODIC,TIME_MS,
-                                                udpstorm_timer_cb);
+   udpstorm_vars.timerId     = opentimers_startTask(UDPSTORMPERIOD,
+                                                    0,
+                                                    TIMER_PERIODIC,TIME_MS,
+                                                    udpstorm_task_cb,
+                                                    TASKPRIO_COAP);
    udpstorm_vars.seqNum      = 0;
 }
 
@@ -71,12 +72,6 @@ owerror_t udpstorm_receive(OpenQueueEntry_t* msg,
    return E_FAIL;
 }
 
-//timer fired, but we don't want to execute task in ISR mode
-//instead, push task to scheduler with CoAP priority, and let scheduler take care of it
-void udpstorm_timer_cb(){
-   scheduler_push_task(udpstorm_task_cb,TASKPRIO_COAP);
-}
-
 void udpstorm_task_cb() {
    OpenQueueEntry_t* pkt;
    owerror_t           outcome;
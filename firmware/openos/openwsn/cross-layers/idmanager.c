@@ -26,6 +26,7 @@ void idmanager_init() {
 
    eui64_get(idmanager_vars.my64bID.addr_64b);
    packetfunctions_mac64bToMac16b(&idmanager_vars.my64bID,&idmanager_vars.my16bID);
+   idmanager_vars.mySrcSumValid        = FALSE;
 }
 
 bool idmanager_getIsDAGroot() {
@@ -102,12 +103,14 @@ owerror_t idmanager_setMyID(open_addr_t* newID) {
         break;
      case ADDR_64B:
         memcpy(&idmanager_vars.my64bID,newID,sizeof(open_addr_t));
+        idmanager_vars.mySrcSumValid = FALSE;
         break;
      case ADDR_PANID:
         memcpy(&idmanager_vars.myPANID,newID,sizeof(open_addr_t));
         break;
      case ADDR_PREFIX:
         memcpy(&idmanager_vars.myPrefix,newID,sizeof(open_addr_t));
+        idmanager_vars.mySrcSumValid = FALSE;
         break;
      case ADDR_128B:
         //don't set 128b, but rather prefix and 64b
@@ -122,6 +125,39 @@ owerror_t idmanager_setMyID(open_addr_t* newID) {
    return E_SUCCESS;
 }
 
+/**
+\brief Get the cached ones' complement sum of my prefix and EUI64.
+
+packetfunctions_calculateChecksum() uses it for the source address of the IPv6
+pseudo-header. The cache is invalidated each time my prefix or EUI64 changes.
+
+\param[out] sum Where to write the sum.
+
+\returns TRUE if the sum was cached, FALSE if it needs to be recomputed.
+*/
+bool idmanager_getMySrcSum(uint16_t* sum) {
+   bool res;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   *sum = idmanager_vars.mySrcSum;
+   res  = idmanager_vars.mySrcSumValid;
+   ENABLE_INTERRUPTS();
+   return res;
+}
+
+/**
+\brief Cache the ones' complement sum of my prefix and EUI64.
+
+\param[in] sum The sum, folded to 16 bits.
+*/
+void idmanager_setMySrcSum(uint16_t sum) {
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   idmanager_vars.mySrcSum      = sum;
+   idmanager_vars.mySrcSumValid = TRUE;
+   ENABLE_INTERRUPTS();
+}
+
 bool idmanager_isMyAddress(open_addr_t* addr) {
    open_addr_t temp_my128bID;
    bool res;
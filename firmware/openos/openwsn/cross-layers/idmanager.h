@@ -36,6 +36,8 @@ typedef struct {
    open_addr_t   my64bID;
    open_addr_t   myPANID;
    open_addr_t   myPrefix;
+   uint16_t      mySrcSum;           // ones' complement sum of myPrefix and my64bID
+   bool          mySrcSumValid;      // FALSE when my address changed since mySrcSum was computed
 } idmanager_vars_t;
 
 //=========================== prototypes ======================================
@@ -48,6 +50,8 @@ void         idmanager_setIsBridge(bool newRole);
 open_addr_t* idmanager_getMyID(uint8_t type);
 owerror_t      idmanager_setMyID(open_addr_t* newID);
 bool         idmanager_isMyAddress(open_addr_t* addr);
+bool         idmanager_getMySrcSum(uint16_t* sum);
+void         idmanager_setMySrcSum(uint16_t sum);
 void         idmanager_triggerAboutRoot();
 void         idmanager_triggerAboutBridge();
 
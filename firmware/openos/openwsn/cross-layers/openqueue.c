@@ -7,10 +7,24 @@
 //=========================== variables =======================================
 
 openqueue_vars_t openqueue_vars;
+openqueue_dbg_t  openqueue_dbg;
 
 //=========================== prototypes ======================================
 
 void openqueue_reset_entry(OpenQueueEntry_t* entry);
+void openqueue_release_entry(uint8_t i);
+OpenQueueEntry_t* openqueue_getFreeEntry(uint8_t creator, bool small);
+bool openqueue_isControlPlane(uint8_t creator);
+uint8_t openqueue_entryIndex(OpenQueueEntry_t* pkt);
+uint16_t openqueue_asnDiff(asn_t* now, asn_t* past);
+// TX FIFOs
+void openqueue_txIndexAdd(uint8_t i);
+void openqueue_txIndexRemove(uint8_t i);
+uint8_t openqueue_findNbrFifo(open_addr_t* neighbor);
+openqueue_link_t* openqueue_fifoLink(uint8_t i, bool byNbr);
+void openqueue_fifoAppend(openqueue_fifo_t* fifo, uint8_t i, bool byNbr);
+void openqueue_fifoRemove(openqueue_fifo_t* fifo, uint8_t i, bool byNbr);
+uint8_t openqueue_fifoFirstForMac(uint8_t i, bool byNbr);
 
 //=========================== public ==========================================
 
@@ -21,9 +35,69 @@ void openqueue_reset_entry(OpenQueueEntry_t* entry);
 */
 void openqueue_init() {
    uint8_t i;
+   
+   memset(&openqueue_dbg,0,sizeof(openqueue_dbg_t));
+   
+   openqueue_vars.numFreeEntries    = 0;
+   openqueue_vars.numFreeLarge      = 0;
+   openqueue_vars.numFreeSmall      = 0;
+   openqueue_vars.debugPrintCreator = COMPONENT_NULL;
+   for (i=0;i<COMPONENT_MAX;i++) {
+      if (openqueue_isControlPlane(i)==TRUE) {
+         openqueue_vars.quota[i] = QUEUELENGTH;
+      } else {
+         openqueue_vars.quota[i] = OPENQUEUE_DEFAULT_QUOTA;
+      }
+      openqueue_vars.numUsedBy[i] = 0;
+   }
    for (i=0;i<QUEUELENGTH;i++){
-      openqueue_reset_entry(&(openqueue_vars.queue[i]));
+      // entries get a frame buffer when they are allocated
+      openqueue_vars.queue[i].creator   = COMPONENT_NULL;
+      openqueue_vars.queue[i].owner     = COMPONENT_NULL;
+      openqueue_vars.queue[i].packet    = NULL;
+      openqueue_vars.allocatedBy[i]     = COMPONENT_NULL;
+      openqueue_vars.freeEntries[openqueue_vars.numFreeEntries++] = QUEUELENGTH-1-i;
+      openqueue_vars.txIndex[i].fifo    = OPENQUEUE_FIFO_NONE;
+      openqueue_vars.txIndex[i].nbrFifo = OPENQUEUE_NONE;
+   }
+   for (i=0;i<OPENQUEUE_NUM_LARGE;i++) {
+      openqueue_vars.freeLarge[openqueue_vars.numFreeLarge++] = OPENQUEUE_NUM_LARGE-1-i;
+   }
+   for (i=0;i<OPENQUEUE_NUM_SMALL;i++) {
+      openqueue_vars.freeSmall[openqueue_vars.numFreeSmall++] = OPENQUEUE_NUM_SMALL-1-i;
+   }
+   
+   // TX FIFOs
+   openqueue_vars.advFifo.head  = OPENQUEUE_NONE;
+   openqueue_vars.advFifo.tail  = OPENQUEUE_NONE;
+   openqueue_vars.dataFifo.head = OPENQUEUE_NONE;
+   openqueue_vars.dataFifo.tail = OPENQUEUE_NONE;
+   for (i=0;i<OPENQUEUE_NUM_NBRFIFOS;i++) {
+      openqueue_vars.nbrFifo[i].head = OPENQUEUE_NONE;
+      openqueue_vars.nbrFifo[i].tail = OPENQUEUE_NONE;
    }
+   openqueue_vars.lastNbrFifo   = 0;
+   openqueue_vars.numUnindexed  = 0;
+}
+
+/**
+\brief Set the maximum number of entries a component can hold at once.
+
+Allocations by that component fail while it holds that many entries. This does
+not affect the entries it already holds.
+
+\param creator The identifier of the component, taken in COMPONENT_*.
+\param quota   The maximum number of entries, QUEUELENGTH for no limit.
+*/
+void openqueue_setQuota(uint8_t creator, uint8_t quota) {
+   INTERRUPT_DECLARATION();
+   
+   if (creator>=COMPONENT_MAX) {
+      return;
+   }
+   DISABLE_INTERRUPTS();
+   openqueue_vars.quota[creator] = quota;
+   ENABLE_INTERRUPTS();
 }
 
 /**
@@ -36,12 +110,35 @@ status information about several modules in the OpenWSN stack.
 */
 bool debugPrint_queue() {
    debugOpenQueueEntry_t output[QUEUELENGTH];
+   debugOpenQueueStats_t stats;
    uint8_t i;
    for (i=0;i<QUEUELENGTH;i++) {
       output[i].creator = openqueue_vars.queue[i].creator;
       output[i].owner   = openqueue_vars.queue[i].owner;
    }
    openserial_printStatus(STATUS_QUEUE,(uint8_t*)&output,QUEUELENGTH*sizeof(debugOpenQueueEntry_t));
+   
+   // print the next creator which was refused a buffer, if any
+   stats.numUsedCur   = QUEUELENGTH-openqueue_vars.numFreeEntries;
+   stats.numUsedMax   = openqueue_dbg.numUsedMax;
+   stats.creator      = COMPONENT_NULL;
+   stats.numAllocFail = openqueue_dbg.numAllocFail;
+   stats.numRejected  = 0;
+   for (i=0;i<COMPONENT_MAX;i++) {
+      openqueue_vars.debugPrintCreator = (openqueue_vars.debugPrintCreator+1)%COMPONENT_MAX;
+      if (openqueue_dbg.numRejected[openqueue_vars.debugPrintCreator]>0) {
+         stats.creator      = openqueue_vars.debugPrintCreator;
+         stats.numRejected  = openqueue_dbg.numRejected[openqueue_vars.debugPrintCreator];
+         break;
+      }
+   }
+   stats.delayAvg     = 0;
+   if (openqueue_dbg.numDelay>0) {
+      stats.delayAvg  = openqueue_dbg.delaySum/openqueue_dbg.numDelay;
+   }
+   stats.delayMax     = openqueue_dbg.delayMax;
+   stats.numExpired   = openqueue_dbg.numExpired;
+   openserial_printStatus(STATUS_QUEUESTATS,(uint8_t*)&stats,sizeof(debugOpenQueueStats_t));
    return TRUE;
 }
 
@@ -60,29 +157,25 @@ get a new packet buffer to start creating a new packet.
          it could not be allocated (buffer full or not synchronized).
 */
 OpenQueueEntry_t* openqueue_getFreePacketBuffer(uint8_t creator) {
-   uint8_t i;
-   INTERRUPT_DECLARATION();
-   DISABLE_INTERRUPTS();
-   
-   // refuse to allocate if we're not in sync
-   if (ieee154e_isSynch()==FALSE && creator > COMPONENT_IEEE802154E){
-     ENABLE_INTERRUPTS();
-     return NULL;
-   }
-   
-   // if you get here, I will try to allocate a buffer for you
-   
-   // walk through queue and find free entry
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_NULL) {
-         openqueue_vars.queue[i].creator=creator;
-         openqueue_vars.queue[i].owner=COMPONENT_OPENQUEUE;
-         ENABLE_INTERRUPTS(); 
-         return &openqueue_vars.queue[i];
-      }
-   }
-   ENABLE_INTERRUPTS();
-   return NULL;
+   return openqueue_getFreeEntry(creator,FALSE);
+}
+
+/**
+\brief Request a new (free) packet buffer for a short frame.
+
+Same as openqueue_getFreePacketBuffer(), but the frame buffer might only be
+OPENQUEUE_SMALL_LENGTH bytes long. Use it for frames known to be short, such
+as ACKs, KAs and ADVs, which leaves the large buffers to data packets. When no
+small buffer is free, a large one is returned.
+
+\note Build the frame from the initial value of payload, not from a fixed
+      position in the packet buffer.
+
+\returns A pointer to the queue entry when it could be allocated, or NULL when
+         it could not be allocated (buffer full or not synchronized).
+*/
+OpenQueueEntry_t* openqueue_getFreeSmallPacketBuffer(uint8_t creator) {
+   return openqueue_getFreeEntry(creator,TRUE);
 }
 
 
@@ -97,26 +190,29 @@ OpenQueueEntry_t* openqueue_getFreePacketBuffer(uint8_t creator) {
 owerror_t openqueue_freePacketBuffer(OpenQueueEntry_t* pkt) {
    uint8_t i;
    INTERRUPT_DECLARATION();
+   
+   i = openqueue_entryIndex(pkt);
+   
    DISABLE_INTERRUPTS();
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (&openqueue_vars.queue[i]==pkt) {
-         if (openqueue_vars.queue[i].owner==COMPONENT_NULL) {
-            // log the error
-            openserial_printCritical(COMPONENT_OPENQUEUE,ERR_FREEING_UNUSED,
-                                  (errorparameter_t)0,
-                                  (errorparameter_t)0);
-         }
-         openqueue_reset_entry(&(openqueue_vars.queue[i]));
-         ENABLE_INTERRUPTS();
-         return E_SUCCESS;
-      }
+   if (i>=QUEUELENGTH) {
+      // log the error
+      openserial_printCritical(COMPONENT_OPENQUEUE,ERR_FREEING_ERROR,
+                            (errorparameter_t)0,
+                            (errorparameter_t)0);
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
+   }
+   if (openqueue_vars.queue[i].owner==COMPONENT_NULL) {
+      // log the error
+      openserial_printCritical(COMPONENT_OPENQUEUE,ERR_FREEING_TWICE,
+                            (errorparameter_t)i,
+                            (errorparameter_t)0);
+      ENABLE_INTERRUPTS();
+      return E_FAIL;
    }
-   // log the error
-   openserial_printCritical(COMPONENT_OPENQUEUE,ERR_FREEING_ERROR,
-                         (errorparameter_t)0,
-                         (errorparameter_t)0);
+   openqueue_release_entry(i);
    ENABLE_INTERRUPTS();
-   return E_FAIL;
+   return E_SUCCESS;
 }
 
 /**
@@ -129,8 +225,9 @@ void openqueue_removeAllCreatedBy(uint8_t creator) {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    for (i=0;i<QUEUELENGTH;i++){
-      if (openqueue_vars.queue[i].creator==creator) {
-         openqueue_reset_entry(&(openqueue_vars.queue[i]));
+      if (openqueue_vars.queue[i].owner!=COMPONENT_NULL &&
+          openqueue_vars.queue[i].creator==creator) {
+         openqueue_release_entry(i);
       }
    }
    ENABLE_INTERRUPTS();
@@ -146,8 +243,9 @@ void openqueue_removeAllOwnedBy(uint8_t owner) {
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
    for (i=0;i<QUEUELENGTH;i++){
-      if (openqueue_vars.queue[i].owner==owner) {
-         openqueue_reset_entry(&(openqueue_vars.queue[i]));
+      if (owner!=COMPONENT_NULL &&
+          openqueue_vars.queue[i].owner==owner) {
+         openqueue_release_entry(i);
       }
    }
    ENABLE_INTERRUPTS();
@@ -155,6 +253,37 @@ void openqueue_removeAllOwnedBy(uint8_t owner) {
 
 //======= called by RES
 
+/**
+\brief Hand a packet over to the MAC.
+
+The packet is assigned to the virtual component COMPONENT_RES_TO_IEEE802154E
+and appended to the TX FIFOs, so the MAC finds it without searching the queue
+and sends the packets to each neighbor in the order RES handed them over.
+
+Its l2_asn is set to the current ASN, which is how long it waits for the MAC
+is measured. The MAC overwrites l2_asn when it is done with the packet.
+
+\param msg The packet to hand over, already carrying its IEEE802.15.4 header.
+*/
+void openqueue_resSendToMac(OpenQueueEntry_t* msg) {
+   uint8_t i;
+   asn_t   now;
+   INTERRUPT_DECLARATION();
+   
+   i = openqueue_entryIndex(msg);
+   // read before disabling interrupts, the getter has its own critical section
+   ieee154e_getAsnStruct(&now);
+   
+   DISABLE_INTERRUPTS();
+   if (i<QUEUELENGTH && openqueue_vars.txIndex[i].fifo==OPENQUEUE_FIFO_NONE) {
+      memcpy(&msg->l2_asn,&now,sizeof(asn_t));
+      openqueue_txIndexAdd(i);
+      openqueue_vars.txGeneration++;
+   }
+   msg->owner = COMPONENT_RES_TO_IEEE802154E;
+   ENABLE_INTERRUPTS();
+}
+
 OpenQueueEntry_t* openqueue_resGetSentPacket() {
    uint8_t i;
    INTERRUPT_DECLARATION();
@@ -187,63 +316,512 @@ OpenQueueEntry_t* openqueue_resGetReceivedPacket() {
 
 //======= called by IEEE80215E
 
+/**
+\brief Get the oldest packet to send in a TX cell.
+
+\param toNeighbor The neighbor of the cell, or an ADDR_ANYCAST address for a
+   shared cell, which can carry any packet except an ADV.
+
+\returns The packet to send, or NULL if there is none.
+*/
 OpenQueueEntry_t* openqueue_macGetDataPacket(open_addr_t* toNeighbor) {
    uint8_t i;
+   uint8_t j;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
+   i = OPENQUEUE_NONE;
    if (toNeighbor->type==ADDR_64B) {
-      // a neighbor is specified, look for a packet unicast to that neigbhbor
-      for (i=0;i<QUEUELENGTH;i++) {
-         if (openqueue_vars.queue[i].owner==COMPONENT_RES_TO_IEEE802154E &&
-            packetfunctions_sameAddress(toNeighbor,&openqueue_vars.queue[i].l2_nextORpreviousHop)) {
-            ENABLE_INTERRUPTS();
-            return &openqueue_vars.queue[i];
+      if (openqueue_vars.numUnindexed==0) {
+         // a neighbor is specified, serve its FIFO
+         j = openqueue_findNbrFifo(toNeighbor);
+         if (j!=OPENQUEUE_NONE) {
+            i = openqueue_fifoFirstForMac(openqueue_vars.nbrFifo[j].head,TRUE);
          }
-      }
-   } else if (toNeighbor->type==ADDR_ANYCAST) {
-      // anycast case: look for a packet which is either not created by RES
-      // or an KA (created by RES, but not broadcast)
-      for (i=0;i<QUEUELENGTH;i++) {
-         if (openqueue_vars.queue[i].owner==COMPONENT_RES_TO_IEEE802154E &&
-             ( openqueue_vars.queue[i].creator!=COMPONENT_RES ||
-                (
-                   openqueue_vars.queue[i].creator==COMPONENT_RES &&
-                   packetfunctions_isBroadcastMulticast(&(openqueue_vars.queue[i].l2_nextORpreviousHop))==FALSE
-                )
-             )
-            ) {
-            ENABLE_INTERRUPTS();
-            return &openqueue_vars.queue[i];
+      } else {
+         // some packets did not get a nbrFifo, look through all the data
+         // packets, which are in the same order
+         for (i=openqueue_vars.dataFifo.head;i!=OPENQUEUE_NONE;i=openqueue_vars.txIndex[i].txLink.next) {
+            if (openqueue_vars.queue[i].owner==COMPONENT_RES_TO_IEEE802154E &&
+                packetfunctions_sameAddress(toNeighbor,&openqueue_vars.queue[i].l2_nextORpreviousHop)) {
+               break;
+            }
          }
       }
+   } else if (toNeighbor->type==ADDR_ANYCAST) {
+      // anycast case: any packet which is not an ADV
+      i = openqueue_fifoFirstForMac(openqueue_vars.dataFifo.head,FALSE);
    }
    ENABLE_INTERRUPTS();
-   return NULL;
+   if (i==OPENQUEUE_NONE) {
+      return NULL;
+   }
+   return &openqueue_vars.queue[i];
 }
 
 OpenQueueEntry_t* openqueue_macGetAdvPacket() {
    uint8_t i;
    INTERRUPT_DECLARATION();
    DISABLE_INTERRUPTS();
-   for (i=0;i<QUEUELENGTH;i++) {
-      if (openqueue_vars.queue[i].owner==COMPONENT_RES_TO_IEEE802154E &&
-          openqueue_vars.queue[i].creator==COMPONENT_RES              &&
-          packetfunctions_isBroadcastMulticast(&(openqueue_vars.queue[i].l2_nextORpreviousHop))) {
-         ENABLE_INTERRUPTS();
-         return &openqueue_vars.queue[i];
+   i = openqueue_fifoFirstForMac(openqueue_vars.advFifo.head,FALSE);
+   ENABLE_INTERRUPTS();
+   if (i==OPENQUEUE_NONE) {
+      return NULL;
+   }
+   return &openqueue_vars.queue[i];
+}
+
+/**
+\brief Remove a packet the MAC is done with from the TX FIFOs.
+
+This also records how long the packet waited for the MAC.
+
+\pre l2_asn still holds the ASN the packet was handed to the MAC at.
+
+\param pkt The packet, which the MAC is about to return to RES.
+*/
+void openqueue_macRemoveTxPacket(OpenQueueEntry_t* pkt) {
+   uint8_t  i;
+   asn_t    now;
+   uint16_t delay;
+   INTERRUPT_DECLARATION();
+   
+   i = openqueue_entryIndex(pkt);
+   ieee154e_getAsnStruct(&now);
+   
+   DISABLE_INTERRUPTS();
+   if (i<QUEUELENGTH && openqueue_vars.txIndex[i].fifo!=OPENQUEUE_FIFO_NONE) {
+      // maintain the delay stats, halving them before they wrap
+      delay = openqueue_asnDiff(&now,&pkt->l2_asn);
+      if (openqueue_dbg.numDelay==0xffff) {
+         openqueue_dbg.numDelay /= 2;
+         openqueue_dbg.delaySum /= 2;
+      }
+      openqueue_dbg.numDelay++;
+      openqueue_dbg.delaySum += delay;
+      if (delay>openqueue_dbg.delayMax) {
+         openqueue_dbg.delayMax = delay;
       }
+      openqueue_txIndexRemove(i);
    }
    ENABLE_INTERRUPTS();
-   return NULL;
 }
 
+/**
+\brief Tell whether packets were handed to the MAC since some point.
+
+The MAC records this when it looks for the packet to send in a slot, and only
+looks again when it changed.
+
+\note Not locked, it is a single byte. Called from interrupt context.
+
+\returns A counter incremented by openqueue_resSendToMac().
+*/
+uint8_t openqueue_macGetTxGeneration() {
+   return openqueue_vars.txGeneration;
+}
+
+#ifdef OPENQUEUE_TTL_SLOTS
+/**
+\brief Get a packet which waited more than OPENQUEUE_TTL_SLOTS for the MAC.
+
+Only the oldest packet of each TX FIFO is checked, the ones behind it were
+queued later.
+
+\returns The expired packet, which the MAC should return to RES as failed, or
+   NULL if there is none.
+*/
+OpenQueueEntry_t* openqueue_macGetExpiredPacket() {
+   uint8_t i;
+   asn_t   now;
+   INTERRUPT_DECLARATION();
+   
+   ieee154e_getAsnStruct(&now);
+   
+   DISABLE_INTERRUPTS();
+   i = openqueue_fifoFirstForMac(openqueue_vars.dataFifo.head,FALSE);
+   if (i==OPENQUEUE_NONE ||
+       openqueue_asnDiff(&now,&openqueue_vars.queue[i].l2_asn)<=OPENQUEUE_TTL_SLOTS) {
+      i = openqueue_fifoFirstForMac(openqueue_vars.advFifo.head,FALSE);
+      if (i!=OPENQUEUE_NONE &&
+          openqueue_asnDiff(&now,&openqueue_vars.queue[i].l2_asn)<=OPENQUEUE_TTL_SLOTS) {
+         i = OPENQUEUE_NONE;
+      }
+   }
+   if (i==OPENQUEUE_NONE) {
+      ENABLE_INTERRUPTS();
+      return NULL;
+   }
+   if (openqueue_dbg.numExpired<0xff) {
+      openqueue_dbg.numExpired++;
+   }
+   ENABLE_INTERRUPTS();
+   return &openqueue_vars.queue[i];
+}
+#endif
+
 //=========================== private =========================================
 
+/**
+\brief Return an allocated entry and its frame buffer to the free ones.
+
+\pre Called with interrupts disabled, on an entry which is not free.
+
+\param i The index of the entry in the queue.
+*/
+void openqueue_release_entry(uint8_t i) {
+   OpenQueueEntry_t* entry;
+   
+   entry = &openqueue_vars.queue[i];
+
+   // the quota is charged to the allocating component, creator may have changed
+   if (openqueue_vars.allocatedBy[i]<COMPONENT_MAX) {
+      openqueue_vars.numUsedBy[openqueue_vars.allocatedBy[i]]--;
+   }
+   openqueue_vars.allocatedBy[i] = COMPONENT_NULL;
+   openqueue_txIndexRemove(i);
+   ieee154e_forgetPacket(entry);
+   if (entry->packetLength==OPENQUEUE_LARGE_LENGTH) {
+      openqueue_vars.freeLarge[openqueue_vars.numFreeLarge++] =
+         (entry->packet-&openqueue_vars.largeBuf[0][0])/OPENQUEUE_LARGE_LENGTH;
+   } else {
+      openqueue_vars.freeSmall[openqueue_vars.numFreeSmall++] =
+         (entry->packet-&openqueue_vars.smallBuf[0][0])/OPENQUEUE_SMALL_LENGTH;
+   }
+   entry->creator = COMPONENT_NULL;
+   entry->owner   = COMPONENT_NULL;
+   entry->packet  = NULL;
+   openqueue_vars.freeEntries[openqueue_vars.numFreeEntries++] = i;
+}
+
+/**
+\brief Allocate a free entry.
+
+\param creator The component asking for the entry.
+\param small   TRUE if a small frame buffer will do.
+
+\returns The entry, or NULL if none could be allocated.
+*/
+OpenQueueEntry_t* openqueue_getFreeEntry(uint8_t creator, bool small) {
+   OpenQueueEntry_t* entry;
+   uint8_t           i;
+   uint8_t           b;
+   uint8_t           numUsed;
+   INTERRUPT_DECLARATION();
+   DISABLE_INTERRUPTS();
+   
+   // refuse to allocate if we're not in sync
+   if (ieee154e_isSynch()==FALSE && creator > COMPONENT_IEEE802154E){
+     ENABLE_INTERRUPTS();
+     return NULL;
+   }
+   
+   // if you get here, I will try to allocate a buffer for you
+   
+   if (
+         openqueue_vars.numFreeEntries==0 ||
+         (openqueue_vars.numFreeLarge==0 && (small==FALSE || openqueue_vars.numFreeSmall==0))
+      ) {
+      // no free entry, or no free buffer for it
+      if (openqueue_dbg.numAllocFail<0xff) {
+         openqueue_dbg.numAllocFail++;
+      }
+      ENABLE_INTERRUPTS();
+      return NULL;
+   }
+   
+   if (creator<COMPONENT_MAX) {
+      if (
+            openqueue_vars.numUsedBy[creator]>=openqueue_vars.quota[creator] ||
+            (
+               openqueue_isControlPlane(creator)==FALSE &&
+               openqueue_vars.numFreeLarge<=OPENQUEUE_NUM_RESERVED &&
+               (small==FALSE || openqueue_vars.numFreeSmall==0)
+            )
+         ) {
+         // over its quota, or would take a reserved entry
+         if (openqueue_dbg.numRejected[creator]<0xff) {
+            openqueue_dbg.numRejected[creator]++;
+         }
+         ENABLE_INTERRUPTS();
+         return NULL;
+      }
+      openqueue_vars.numUsedBy[creator]++;
+   }
+   
+   // pop a free entry and attach a buffer to it, a small one when that will do
+   i     = openqueue_vars.freeEntries[--openqueue_vars.numFreeEntries];
+   entry = &openqueue_vars.queue[i];
+   if (small==TRUE && openqueue_vars.numFreeSmall>0) {
+      b                   = openqueue_vars.freeSmall[--openqueue_vars.numFreeSmall];
+      entry->packet       = openqueue_vars.smallBuf[b];
+      entry->packetLength = OPENQUEUE_SMALL_LENGTH;
+   } else {
+      b                   = openqueue_vars.freeLarge[--openqueue_vars.numFreeLarge];
+      entry->packet       = openqueue_vars.largeBuf[b];
+      entry->packetLength = OPENQUEUE_LARGE_LENGTH;
+   }
+   openqueue_reset_entry(entry);
+   entry->creator=creator;
+   entry->owner=COMPONENT_OPENQUEUE;
+   openqueue_vars.allocatedBy[i]=creator;
+   
+   // maintain debug stats
+   numUsed = QUEUELENGTH-openqueue_vars.numFreeEntries;
+   if (numUsed>openqueue_dbg.numUsedMax) {
+      openqueue_dbg.numUsedMax = numUsed;
+   }
+   
+   ENABLE_INTERRUPTS();
+   return entry;
+}
+
+/**
+\brief Whether a component belongs to the control plane.
+
+The control plane keeps the network running: the MAC (which also receives the
+packets to relay), RES (ADVs and KAs), RPL (DIOs and DAOs) and forwarding. It
+is not subject to quotas by default, and it is the only one which can allocate
+the last OPENQUEUE_NUM_RESERVED large entries.
+*/
+bool openqueue_isControlPlane(uint8_t creator) {
+   switch (creator) {
+      case COMPONENT_IEEE802154E:
+      case COMPONENT_RES:
+      case COMPONENT_ICMPv6RPL:
+      case COMPONENT_FORWARDING:
+         return TRUE;
+      default:
+         return FALSE;
+   }
+}
+
+/**
+\brief Get the index of an entry from its address.
+
+\returns The index of the entry in the queue, or QUEUELENGTH if pkt does not
+   point to an entry.
+*/
+uint8_t openqueue_entryIndex(OpenQueueEntry_t* pkt) {
+   uint8_t i;
+   
+   if (pkt<&openqueue_vars.queue[0] || pkt>&openqueue_vars.queue[QUEUELENGTH-1]) {
+      return QUEUELENGTH;
+   }
+   i = pkt-&openqueue_vars.queue[0];
+   if (&openqueue_vars.queue[i]!=pkt) {
+      return QUEUELENGTH;
+   }
+   return i;
+}
+
+/**
+\brief Number of slots between two ASNs.
+
+Unlike ieee154e_asnDiff(), this does not lock, so it can be called with
+interrupts disabled.
+
+\param now  The later ASN.
+\param past The earlier ASN.
+
+\returns The number of slots from past to now, 0xffff if that many or more.
+*/
+uint16_t openqueue_asnDiff(asn_t* now, asn_t* past) {
+   uint32_t diff;
+   
+   if (now->byte4!=past->byte4) {
+      return 0xffff;
+   }
+   if (now->bytes2and3==past->bytes2and3) {
+      diff  = now->bytes0and1-past->bytes0and1;
+   } else if ((uint16_t)(now->bytes2and3-past->bytes2and3)==1) {
+      diff  = now->bytes0and1;
+      diff += 0x10000-past->bytes0and1;
+   } else {
+      return 0xffff;
+   }
+   if (diff>0xffff) {
+      return 0xffff;
+   }
+   return (uint16_t)diff;
+}
+
+//======= TX FIFOs
+
+/**
+\brief Append an entry to the TX FIFOs it belongs to.
+
+ADVs go to advFifo. All other packets go to dataFifo and, when unicast, to the
+FIFO of their next hop. When all nbrFifos are in use by other neighbors, the
+packet is only in dataFifo and is counted in numUnindexed.
+
+\pre Called with interrupts disabled, on an entry which is in no TX FIFO.
+
+\param i The index of the entry in the queue.
+*/
+void openqueue_txIndexAdd(uint8_t i) {
+   openqueue_txIndex_t* index;
+   open_addr_t*         nextHop;
+   uint8_t              j;
+   
+   index   = &openqueue_vars.txIndex[i];
+   nextHop = &openqueue_vars.queue[i].l2_nextORpreviousHop;
+   
+   if (openqueue_vars.queue[i].creator==COMPONENT_RES &&
+       packetfunctions_isBroadcastMulticast(nextHop)==TRUE) {
+      index->fifo = OPENQUEUE_FIFO_ADV;
+      openqueue_fifoAppend(&openqueue_vars.advFifo,i,FALSE);
+      return;
+   }
+   
+   index->fifo = OPENQUEUE_FIFO_DATA;
+   openqueue_fifoAppend(&openqueue_vars.dataFifo,i,FALSE);
+   if (nextHop->type!=ADDR_64B) {
+      return;
+   }
+   
+   // find the FIFO of that neighbor, or a free one
+   j = openqueue_findNbrFifo(nextHop);
+   if (j==OPENQUEUE_NONE) {
+      for (j=0;j<OPENQUEUE_NUM_NBRFIFOS;j++) {
+         if (openqueue_vars.nbrFifo[j].head==OPENQUEUE_NONE) {
+            break;
+         }
+      }
+   }
+   if (j<OPENQUEUE_NUM_NBRFIFOS) {
+      index->nbrFifo = j;
+      openqueue_fifoAppend(&openqueue_vars.nbrFifo[j],i,TRUE);
+   } else {
+      openqueue_vars.numUnindexed++;
+   }
+}
+
+/**
+\brief Remove an entry from the TX FIFOs it is in, if any.
+
+\pre Called with interrupts disabled.
+
+\param i The index of the entry in the queue.
+*/
+void openqueue_txIndexRemove(uint8_t i) {
+   openqueue_txIndex_t* index;
+   
+   index = &openqueue_vars.txIndex[i];
+   switch (index->fifo) {
+      case OPENQUEUE_FIFO_ADV:
+         openqueue_fifoRemove(&openqueue_vars.advFifo,i,FALSE);
+         break;
+      case OPENQUEUE_FIFO_DATA:
+         openqueue_fifoRemove(&openqueue_vars.dataFifo,i,FALSE);
+         if (index->nbrFifo!=OPENQUEUE_NONE) {
+            // removing the last packet to that neighbor frees its FIFO
+            openqueue_fifoRemove(&openqueue_vars.nbrFifo[index->nbrFifo],i,TRUE);
+         } else if (openqueue_vars.queue[i].l2_nextORpreviousHop.type==ADDR_64B) {
+            openqueue_vars.numUnindexed--;
+         }
+         break;
+      default:
+         return;
+   }
+   index->fifo    = OPENQUEUE_FIFO_NONE;
+   index->nbrFifo = OPENQUEUE_NONE;
+}
+
+/**
+\brief Find the FIFO of a neighbor.
+
+A FIFO in use belongs to the next hop of the packets in it, which is read from
+its head.
+
+\returns The index of the FIFO in nbrFifo, or OPENQUEUE_NONE if that neighbor
+   has none.
+*/
+uint8_t openqueue_findNbrFifo(open_addr_t* neighbor) {
+   uint8_t j;
+   uint8_t head;
+   
+   // consecutive TX cells are often to the same neighbor
+   head = openqueue_vars.nbrFifo[openqueue_vars.lastNbrFifo].head;
+   if (head!=OPENQUEUE_NONE &&
+       packetfunctions_sameAddress(neighbor,&openqueue_vars.queue[head].l2_nextORpreviousHop)) {
+      return openqueue_vars.lastNbrFifo;
+   }
+   for (j=0;j<OPENQUEUE_NUM_NBRFIFOS;j++) {
+      head = openqueue_vars.nbrFifo[j].head;
+      if (head!=OPENQUEUE_NONE &&
+          packetfunctions_sameAddress(neighbor,&openqueue_vars.queue[head].l2_nextORpreviousHop)) {
+         openqueue_vars.lastNbrFifo = j;
+         return j;
+      }
+   }
+   return OPENQUEUE_NONE;
+}
+
+/**
+\brief Get the links of an entry in either kind of FIFO.
+
+\param i     The index of the entry in the queue.
+\param byNbr TRUE for its position in a nbrFifo, FALSE for its position in
+   advFifo or dataFifo.
+*/
+openqueue_link_t* openqueue_fifoLink(uint8_t i, bool byNbr) {
+   if (byNbr==TRUE) {
+      return &openqueue_vars.txIndex[i].nbrLink;
+   }
+   return &openqueue_vars.txIndex[i].txLink;
+}
+
+void openqueue_fifoAppend(openqueue_fifo_t* fifo, uint8_t i, bool byNbr) {
+   openqueue_link_t* link;
+   
+   link       = openqueue_fifoLink(i,byNbr);
+   link->prev = fifo->tail;
+   link->next = OPENQUEUE_NONE;
+   if (fifo->tail==OPENQUEUE_NONE) {
+      fifo->head = i;
+   } else {
+      openqueue_fifoLink(fifo->tail,byNbr)->next = i;
+   }
+   fifo->tail = i;
+}
+
+void openqueue_fifoRemove(openqueue_fifo_t* fifo, uint8_t i, bool byNbr) {
+   openqueue_link_t* link;
+   
+   link = openqueue_fifoLink(i,byNbr);
+   if (link->prev==OPENQUEUE_NONE) {
+      fifo->head = link->next;
+   } else {
+      openqueue_fifoLink(link->prev,byNbr)->next = link->next;
+   }
+   if (link->next==OPENQUEUE_NONE) {
+      fifo->tail = link->prev;
+   } else {
+      openqueue_fifoLink(link->next,byNbr)->prev = link->prev;
+   }
+}
+
+/**
+\brief Get the first entry, starting at i, which the MAC can send.
+
+This skips the packet the MAC is currently transmitting, which stays in the
+FIFOs until it is sent, so it keeps its position if it needs to be retried.
+
+\returns The index of that entry, or OPENQUEUE_NONE if there is none.
+*/
+uint8_t openqueue_fifoFirstForMac(uint8_t i, bool byNbr) {
+   while (i!=OPENQUEUE_NONE &&
+          openqueue_vars.queue[i].owner!=COMPONENT_RES_TO_IEEE802154E) {
+      i = openqueue_fifoLink(i,byNbr)->next;
+   }
+   return i;
+}
+
 void openqueue_reset_entry(OpenQueueEntry_t* entry) {
    //admin
    entry->creator                      = COMPONENT_NULL;
    entry->owner                        = COMPONENT_NULL;
-   entry->payload                      = &(entry->packet[127]);
+   entry->payload                      = &(entry->packet[entry->packetLength-3]);
    entry->length                       = 0;
    //l4
    entry->l4_protocol                  = IANA_UNDEFINED;
@@ -253,5 +831,6 @@ void openqueue_reset_entry(OpenQueueEntry_t* entry) {
    //l2
    entry->l2_nextORpreviousHop.type    = ADDR_NONE;
    entry->l2_frameType                 = IEEE154_TYPE_UNDEFINED;
+   entry->l2_framePending              = FALSE;
    entry->l2_retriesLeft               = 0;
 }
@@ -13,7 +13,31 @@
 
 //=========================== define ==========================================
 
-#define QUEUELENGTH  10
+// an entry gets a large or a small frame buffer when it is allocated
+#define QUEUELENGTH             11
+#define OPENQUEUE_NUM_LARGE     5
+#define OPENQUEUE_NUM_SMALL     6
+
+#define OPENQUEUE_LARGE_LENGTH  (1+1+125+2+1) // 1B spi address, 1B length, 125B data, 2B CRC, 1B LQI
+#define OPENQUEUE_SMALL_LENGTH  40            // enough for an ACK, a KA or an ADV
+
+// large buffers only the control plane can allocate (see openqueue_isControlPlane()),
+// so RPL and the MAC receive buffers still get one when applications use up the rest
+#define OPENQUEUE_NUM_RESERVED  2
+// default number of entries a component outside the control plane can hold
+#define OPENQUEUE_DEFAULT_QUOTA (QUEUELENGTH/2)
+
+// uncomment to give up on packets which waited that many slots for the MAC
+//#define OPENQUEUE_TTL_SLOTS     1000
+
+#define OPENQUEUE_NONE          0xff  // "no entry" in the TX FIFOs
+#define OPENQUEUE_NUM_NBRFIFOS  4     // number of neighbors with their own TX FIFO
+
+enum {
+   OPENQUEUE_FIFO_NONE = 0,           // entry not waiting for the MAC
+   OPENQUEUE_FIFO_ADV  = 1,           // entry is an ADV, in advFifo
+   OPENQUEUE_FIFO_DATA = 2,           // entry is any other frame, in dataFifo
+};
 
 //=========================== typedef =========================================
 
@@ -22,28 +46,97 @@ typedef struct {
    uint8_t  owner;
 } debugOpenQueueEntry_t;
 
+PRAGMA(pack(1));
+typedef struct {
+   uint8_t  numUsedCur;
+   uint8_t  numUsedMax;
+   uint8_t  creator;
+   uint8_t  numAllocFail;
+   uint8_t  numRejected;
+   uint16_t delayAvg;      // average time spent waiting for the MAC, in slots
+   uint16_t delayMax;      // maximum time spent waiting for the MAC, in slots
+   uint8_t  numExpired;    // packets dropped after OPENQUEUE_TTL_SLOTS
+} debugOpenQueueStats_t;
+PRAGMA(pack());
+
+typedef struct {
+   uint8_t          head;                        // oldest entry, OPENQUEUE_NONE if empty
+   uint8_t          tail;                        // newest entry, OPENQUEUE_NONE if empty
+} openqueue_fifo_t;
+
+typedef struct {
+   uint8_t          prev;                        // towards the head of the FIFO
+   uint8_t          next;                        // towards the tail of the FIFO
+} openqueue_link_t;
+
+typedef struct {
+   uint8_t          fifo;                        // OPENQUEUE_FIFO_* this entry is in
+   uint8_t          nbrFifo;                     // index in nbrFifo, OPENQUEUE_NONE if none
+   openqueue_link_t txLink;                      // position in advFifo or dataFifo
+   openqueue_link_t nbrLink;                     // position in nbrFifo[nbrFifo]
+} openqueue_txIndex_t;
+
 //=========================== module variables ================================
 
 typedef struct {
    OpenQueueEntry_t queue[QUEUELENGTH];
+   uint8_t          largeBuf[OPENQUEUE_NUM_LARGE][OPENQUEUE_LARGE_LENGTH];
+   uint8_t          smallBuf[OPENQUEUE_NUM_SMALL][OPENQUEUE_SMALL_LENGTH];
+   uint8_t          freeEntries[QUEUELENGTH];    // indexes of the free entries
+   uint8_t          numFreeEntries;              // number of valid elements in freeEntries
+   uint8_t          freeLarge[OPENQUEUE_NUM_LARGE]; // indexes of the free large buffers
+   uint8_t          numFreeLarge;                // number of valid elements in freeLarge
+   uint8_t          freeSmall[OPENQUEUE_NUM_SMALL]; // indexes of the free small buffers
+   uint8_t          numFreeSmall;                // number of valid elements in freeSmall
+   uint8_t          debugPrintCreator;
+   // quotas
+   uint8_t          quota[COMPONENT_MAX];        // max number of entries each creator can hold
+   uint8_t          numUsedBy[COMPONENT_MAX];    // number of entries each creator holds
+   uint8_t          allocatedBy[QUEUELENGTH];    // creator which allocated each entry
+   // TX FIFOs, in the order the packets were handed to the MAC
+   openqueue_txIndex_t txIndex[QUEUELENGTH];     // position of each entry in the TX FIFOs
+   openqueue_fifo_t    advFifo;                  // ADVs
+   openqueue_fifo_t    dataFifo;                 // all other frames, anycast candidates
+   openqueue_fifo_t    nbrFifo[OPENQUEUE_NUM_NBRFIFOS]; // unicast frames, per neighbor, free when empty
+   uint8_t             lastNbrFifo;              // nbrFifo hit by the last lookup
+   uint8_t             numUnindexed;             // unicast frames which did not get a nbrFifo
+   uint8_t             txGeneration;             // incremented each time a packet is handed to the MAC
 } openqueue_vars_t;
 
+typedef struct {
+   uint8_t          numUsedMax;                  // high-water mark of the allocated entries
+   uint8_t          numAllocFail;                // failed allocations, all creators
+   uint8_t          numRejected[COMPONENT_MAX];  // allocations refused by quota or reservation, per creator
+   uint32_t         delaySum;                    // sum of the delays in numDelay, in slots
+   uint16_t         numDelay;                    // number of packets in delaySum
+   uint16_t         delayMax;                    // longest a packet waited for the MAC, in slots
+   uint8_t          numExpired;                  // packets the MAC gave up on after OPENQUEUE_TTL_SLOTS
+} openqueue_dbg_t;
+
 //=========================== prototypes ======================================
 
 // admin
 void               openqueue_init();
+void               openqueue_setQuota(uint8_t creator, uint8_t quota);
 bool               debugPrint_queue();
 // called by any component
 OpenQueueEntry_t*  openqueue_getFreePacketBuffer(uint8_t creator);
+OpenQueueEntry_t*  openqueue_getFreeSmallPacketBuffer(uint8_t creator);
 owerror_t         openqueue_freePacketBuffer(OpenQueueEntry_t* pkt);
 void               openqueue_removeAllCreatedBy(uint8_t creator);
 void               openqueue_removeAllOwnedBy(uint8_t owner);
 // called by res
+void               openqueue_resSendToMac(OpenQueueEntry_t* msg);
 OpenQueueEntry_t*  openqueue_resGetSentPacket();
 OpenQueueEntry_t*  openqueue_resGetReceivedPacket();
 // called by IEEE80215E
 OpenQueueEntry_t*  openqueue_macGetDataPacket(open_addr_t* toNeighbor);
 OpenQueueEntry_t*  openqueue_macGetAdvPacket();
+void               openqueue_macRemoveTxPacket(OpenQueueEntry_t* pkt);
+uint8_t            openqueue_macGetTxGeneration();
+#ifdef OPENQUEUE_TTL_SLOTS
+OpenQueueEntry_t*  openqueue_macGetExpiredPacket();
+#endif
 
 /**
 \}
@@ -1,12 +1,14 @@
 #include "packetfunctions.h"
 #include "openserial.h"
 #include "idmanager.h"
+#include "opencrc.h"
 
 //=========================== variables =======================================
 
 //=========================== prototypes ======================================
 
-void onesComplementSum(uint8_t* global_sum, uint8_t* ptr, int length);
+uint32_t onesComplementSum(uint32_t sum, uint8_t* ptr, uint16_t length);
+uint16_t onesComplementFold(uint32_t sum);
 
 //=========================== public ==========================================
 
@@ -278,7 +280,7 @@ void packetfunctions_reserveHeaderSize(OpenQueueEntry_t* pkt, uint8_t header_len
 void packetfunctions_tossHeader(OpenQueueEntry_t* pkt, uint8_t header_length) {
    pkt->payload += header_length;
    pkt->length  -= header_length;
-   if ( (uint8_t*)(pkt->payload) > (uint8_t*)(pkt->packet+126) ) {
+   if ( (uint8_t*)(pkt->payload) > (uint8_t*)(pkt->packet+pkt->packetLength-4) ) {
       openserial_printError(COMPONENT_PACKETFUNCTIONS,ERR_HEADER_TOO_LONG,
                             (errorparameter_t)1,
                             (errorparameter_t)pkt->length);
@@ -287,7 +289,7 @@ void packetfunctions_tossHeader(OpenQueueEntry_t* pkt, uint8_t header_length) {
 
 void packetfunctions_reserveFooterSize(OpenQueueEntry_t* pkt, uint8_t header_length) {
    pkt->length  += header_length;
-   if (pkt->length>127) {
+   if (pkt->length>127 || pkt->payload+pkt->length>pkt->packet+pkt->packetLength) {
       openserial_printError(COMPONENT_PACKETFUNCTIONS,ERR_HEADER_TOO_LONG,
                             (errorparameter_t)2,
                             (errorparameter_t)pkt->length);
@@ -307,19 +309,9 @@ void packetfunctions_tossFooter(OpenQueueEntry_t* pkt, uint8_t header_length) {
 
 void packetfunctions_calculateCRC(OpenQueueEntry_t* msg) {
    uint16_t crc;
-   uint8_t  i;
-   uint8_t  count;
    crc = 0;
-   for (count=1;count<msg->length-2;count++) {
-      crc = crc ^ (uint8_t)*(msg->payload+count);
-      //crc = crc ^ (uint16_t)*ptr++ << 8;
-      for (i=0;i<8;i++) {
-         if (crc & 0x1) {
-            crc = crc >> 1 ^ 0x8408;
-         } else {
-            crc = crc >> 1;
-         }
-      }
+   if (msg->length>3) {
+      crc = opencrc_update(crc,msg->payload+1,msg->length-3);
    }
    *(msg->payload+(msg->length-2)) = crc%256;
    *(msg->payload+(msg->length-1)) = crc/256;
@@ -327,19 +319,9 @@ void packetfunctions_calculateCRC(OpenQueueEntry_t* msg) {
 
 bool packetfunctions_checkCRC(OpenQueueEntry_t* msg) {
    uint16_t crc;
-   uint8_t  i;
-   uint8_t  count;
    crc = 0;
-   for (count=0;count<msg->length-2;count++) {
-      crc = crc ^ (uint8_t)*(msg->payload+count);
-      //crc = crc ^ (uint16_t)*ptr++ << 8;
-      for (i=0;i<8;i++) {
-         if (crc & 0x1) {
-            crc = crc >> 1 ^ 0x8408;
-         } else {
-            crc = crc >> 1;
-         }
-      }
+   if (msg->length>2) {
+      crc = opencrc_update(crc,msg->payload,msg->length-2);
    }
    if (*(msg->payload+(msg->length-2))==crc%256 &&
        *(msg->payload+(msg->length-1))==crc/256) {
@@ -354,31 +336,26 @@ bool packetfunctions_checkCRC(OpenQueueEntry_t* msg) {
 //see http://www-net.cs.umass.edu/kurose/transport/UDP.html, or http://tools.ietf.org/html/rfc1071
 //see http://en.wikipedia.org/wiki/User_Datagram_Protocol#IPv6_PSEUDO-HEADER
 void packetfunctions_calculateChecksum(OpenQueueEntry_t* msg, uint8_t* checksum_ptr) {
-   uint8_t temp_checksum[2];
-   uint8_t little_helper[2];
-   
-   // initialize running checksum
-   temp_checksum[0]  = 0;
-   temp_checksum[1]  = 0;
+   uint32_t sum;
+   uint16_t mySrcSum;
    
    //===== IPv6 pseudo header
    
-   // source address (prefix and EUI64)
-   onesComplementSum(temp_checksum,(idmanager_getMyID(ADDR_PREFIX))->prefix,8);
-   onesComplementSum(temp_checksum,(idmanager_getMyID(ADDR_64B))->addr_64b,8);
+   // source address (prefix and EUI64), only summed when it changes
+   if (idmanager_getMySrcSum(&mySrcSum)==FALSE) {
+      sum = onesComplementSum(0,  (idmanager_getMyID(ADDR_PREFIX))->prefix,8);
+      sum = onesComplementSum(sum,(idmanager_getMyID(ADDR_64B))->addr_64b,8);
+      mySrcSum = onesComplementFold(sum);
+      idmanager_setMySrcSum(mySrcSum);
+   }
+   sum  = mySrcSum;
    
    // destination address
-   onesComplementSum(temp_checksum,msg->l3_destinationAdd.addr_128b,16);
-   
-   // length
-   little_helper[0] = 0;
-   little_helper[1] = msg->length;
-   onesComplementSum(temp_checksum,little_helper,2);
+   sum  = onesComplementSum(sum,msg->l3_destinationAdd.addr_128b,16);
    
-   // next header
-   little_helper[0] = 0;
-   little_helper[1] = msg->l4_protocol;
-   onesComplementSum(temp_checksum,little_helper,2);
+   // length and next header
+   sum += msg->length;
+   sum += msg->l4_protocol;
    
    //===== payload
    
@@ -386,31 +363,46 @@ void packetfunctions_calculateChecksum(OpenQueueEntry_t* msg, uint8_t* checksum_
    *checksum_ptr     = 0;
    *(checksum_ptr+1) = 0;
    
-   onesComplementSum(temp_checksum,msg->payload,msg->length);
-   temp_checksum[0] ^= 0xFF;
-   temp_checksum[1] ^= 0xFF;
+   sum  = onesComplementSum(sum,msg->payload,msg->length);
    
    //write in packet
-   *checksum_ptr     = temp_checksum[0];
-   *(checksum_ptr+1) = temp_checksum[1];
+   packetfunctions_htons((uint16_t)~onesComplementFold(sum),checksum_ptr);
 }
 
+/**
+\brief Add bytes to a running ones' complement sum.
 
-void onesComplementSum(uint8_t* global_sum, uint8_t* ptr, int length) {
-   uint32_t sum = 0xFFFF & (global_sum[0]<<8 | global_sum[1]);
+The bytes are added as big endian 16-bit words. The carries are kept in the
+upper bits of the 32-bit sum, and only folded back by onesComplementFold(),
+once all bytes are added.
+
+\param[in] sum    The running sum.
+\param[in] ptr    The bytes to add.
+\param[in] length The number of bytes to add. If odd, the last byte is padded
+                  with a zero byte.
+
+\returns The new running sum.
+*/
+uint32_t onesComplementSum(uint32_t sum, uint8_t* ptr, uint16_t length) {
    while (length>1) {
-      sum     += 0xFFFF & (*ptr<<8 | *(ptr+1));
+      sum     += ((uint16_t)ptr[0]<<8) | ptr[1];
       ptr     += 2;
       length  -= 2;
    }
    if (length) {
-      sum     += (0xFF & *ptr)<<8;
+      sum     += (uint16_t)ptr[0]<<8;
    }
+   return sum;
+}
+
+/**
+\brief Fold the carries of a running sum into a 16-bit ones' complement sum.
+*/
+uint16_t onesComplementFold(uint32_t sum) {
    while (sum>>16) {
       sum      = (sum & 0xFFFF)+(sum >> 16);
    }
-   global_sum[0] = (sum>>8) & 0xFF;
-   global_sum[1] = sum & 0xFF;
+   return (uint16_t)sum;
 }
 
 //======= endianness
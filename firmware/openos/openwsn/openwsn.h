@@ -101,7 +101,12 @@ enum {
    STATUS_BACKOFF                      =  7,
    STATUS_QUEUE                        =  8,
    STATUS_NEIGHBORS                    =  9,
-   STATUS_MAX                          = 10,
+   STATUS_SCHEDULER                    = 10,
+   STATUS_QUEUESTATS                   = 11,
+   STATUS_OPENTIMERS                   = 12,
+   STATUS_CHANNELSTATS                 = 13,
+   STATUS_TRACE                        = 14, // format: see ieee154e_traceEntry_t
+   STATUS_MAX                          = 15,
 };
 
 //component identifiers
@@ -172,6 +177,7 @@ enum {
    COMPONENT_UDPLATENCY                = 0x2f,
    COMPONENT_TEST                      = 0x30,
    COMPONENT_R6TUS                    = 0x31,
+   COMPONENT_MAX                       = 0x32,
 };
 
 /**
@@ -243,6 +249,7 @@ enum {
    ERR_INVALIDPACKETFROMRADIO          = 0x35, // invalid packet frome radio, length {1} (code location {0})
    ERR_BUSY_RECEIVING                  = 0x36, // busy receiving when stop of serial activity, buffer input length {1} (code location {0})
    ERR_WRONG_CRC_INPUT                  = 0x37, // wrong CRC in input Buffer (input length {0})
+   ERR_FREEING_TWICE                   = 0x38, // freeing packet buffer {0} which is already free
 };
 
 //=========================== typedef =========================================
@@ -282,7 +289,6 @@ typedef struct {
    uint8_t       length;                         // length in bytes of the payload
    //l4
    uint8_t       l4_protocol;                    // l4 protocol to be used
-   bool          l4_protocol_compressed;         // is the l4 protocol header compressed?
    uint16_t      l4_sourcePortORicmpv6Type;      // l4 source port
    uint16_t      l4_destination_port;            // l4 destination port
    uint8_t*      l4_payload;                     // pointer to the start of the payload of l4 (used for retransmits)
@@ -291,9 +297,7 @@ typedef struct {
    open_addr_t   l3_destinationAdd;              // 128b IPv6 destination (down stack) 
    open_addr_t   l3_sourceAdd;                   // 128b IPv6 source address 
    //l2
-   owerror_t       l2_sendDoneError;               // outcome of trying to send this packet
    open_addr_t   l2_nextORpreviousHop;           // 64b IEEE802.15.4 next (down stack) or previous (up) hop address
-   uint8_t       l2_frameType;                   // beacon, data, ack, cmd
    uint8_t       l2_dsn;                         // sequence number of the received frame
    uint8_t       l2_retriesLeft;                 // number Tx retries left before packet dropped (dropped when hits 0)
    uint8_t       l2_numTxAttempts;               // number Tx attempts
@@ -304,8 +308,14 @@ typedef struct {
    int8_t        l1_rssi;                        // RSSI of received packet
    uint8_t       l1_lqi;                         // LQI of received packet
    bool          l1_crc;                         // did received packet pass CRC check?
+   //flags, sharing a byte
+   uint8_t       l4_protocol_compressed:1;       // is the l4 protocol header compressed?
+   uint8_t       l2_sendDoneError:1;             // outcome of trying to send this packet (owerror_t)
+   uint8_t       l2_frameType:3;                 // beacon, data, ack, cmd
+   uint8_t       l2_framePending:1;              // frame pending bit of the received frame
    //the packet
-   uint8_t       packet[1+1+125+2+1];            // 1B spi address, 1B length, 125B data, 2B CRC, 1B LQI
+   uint8_t*      packet;                         // frame buffer, attached by openqueue
+   uint8_t       packetLength;                   // size of the frame buffer, in bytes
 } OpenQueueEntry_t;
 
 //=========================== variables =======================================
@@ -0,0 +1,127 @@
+/**
+\brief This is a program which measures the drift of a periodic "opentimers"
+   timer.
+
+A periodic timer with some slack runs for #APP_NUM_PERIODS periods, while a
+second timer with a different period makes the hardware timer fire inside its
+slack window, so it fires late by a varying amount. At each expiration, the
+time elapsed since the timer was started, read from the bsp_timer counter, is
+compared to the number of periods times the period.
+
+A timer re-armed against its previous deadline only lags by how late the
+current expiration is; one re-armed against the time it fired accumulates
+that lateness over all periods, and drifts.
+
+When done, the sync LED is switched on if the lag always stayed under
+#APP_MAX_LAG_TICKS; the error LED is switched on otherwise. app_vars holds
+the measurements.
+
+\note With the default values, this takes about 17 minutes on a mote.
+
+Since the driver modules for different platforms have the same declaration, you
+can use this project with any platform.
+*/
+
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+// bsp modules required
+#include "board.h"
+#include "leds.h"
+#include "bsp_timer.h"
+// driver modules required
+#include "opentimers.h"
+
+//=========================== defines =========================================
+
+#define APP_NUM_PERIODS     1000000
+#define APP_PERIOD_TICKS         33    // about 1ms at 32kHz
+#define APP_SLACK_TICKS           8
+#define APP_OTHER_TICKS          47    // not a multiple of APP_PERIOD_TICKS
+#define APP_MAX_LAG_TICKS        (APP_SLACK_TICKS+16) // slack, plus interrupt latency
+
+//=========================== variables =======================================
+
+typedef struct {
+   opentimer_id_t   timerId;
+   opentimer_id_t   otherId;
+   PORT_TIMER_WIDTH lastValue;      // bsp_timer counter at the last expiration
+   uint32_t         elapsed;        // ticks since the timer was started
+   uint32_t         numPeriods;     // number of expirations
+   int32_t          lag;            // ticks the last expiration was late by
+   int32_t          lagMin;
+   int32_t          lagMax;
+   bool             done;
+} app_vars_t;
+
+app_vars_t app_vars;
+
+//=========================== prototypes ======================================
+
+void cb_period();
+void cb_other();
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main() {
+   
+   memset(&app_vars,0,sizeof(app_vars_t));
+   
+   board_init();
+   opentimers_init();
+   
+   // the bsp_timer is reset when the first timer starts
+   app_vars.timerId = opentimers_startWithSlack(APP_PERIOD_TICKS,
+                                       APP_SLACK_TICKS,
+                                       TIMER_PERIODIC,TIME_TICS,
+                                       cb_period);
+   app_vars.otherId = opentimers_start(APP_OTHER_TICKS,
+                                       TIMER_PERIODIC,TIME_TICS,
+                                       cb_other);
+   
+   while(1) {
+      board_sleep();
+   }
+}
+
+//=========================== callbacks =======================================
+
+void cb_period() {
+   PORT_TIMER_WIDTH now;
+   
+   if (app_vars.done==TRUE) {
+      return;
+   }
+   
+   // accumulate the counter, which wraps around far less often than we read it
+   now                 = bsp_timer_get_currentValue();
+   app_vars.elapsed   += (PORT_TIMER_WIDTH)(now-app_vars.lastValue);
+   app_vars.lastValue  = now;
+   app_vars.numPeriods++;
+   
+   app_vars.lag        = (int32_t)(app_vars.elapsed-app_vars.numPeriods*APP_PERIOD_TICKS);
+   if (app_vars.lag<app_vars.lagMin) {
+      app_vars.lagMin  = app_vars.lag;
+   }
+   if (app_vars.lag>app_vars.lagMax) {
+      app_vars.lagMax  = app_vars.lag;
+   }
+   
+   if (app_vars.numPeriods==APP_NUM_PERIODS) {
+      app_vars.done    = TRUE;
+      opentimers_stop(app_vars.timerId);
+      opentimers_stop(app_vars.otherId);
+      if (app_vars.lagMin>=0 && app_vars.lagMax<=APP_MAX_LAG_TICKS) {
+         leds_sync_on();
+      } else {
+         leds_error_on();
+      }
+   }
+}
+
+void cb_other() {
+   leds_radio_toggle();
+}
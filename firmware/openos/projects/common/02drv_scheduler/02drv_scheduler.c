@@ -0,0 +1,199 @@
+/**
+\brief This is a program which stress tests the "scheduler" kernel module.
+
+It fills all the task containers, pushes more tasks than the scheduler can
+hold, and checks the scheduler_dbg counters against what the
+#SCHEDULER_OVERFLOW_POLICY compiled in should do. It then lets the scheduler
+run the tasks, and checks they run in priority order.
+
+The sync LED is switched on if all checks pass; the error LED is switched on,
+and app_vars.failedLine holds the line of the first failing check, otherwise.
+
+To test another policy, change #SCHEDULER_OVERFLOW_POLICY in scheduler.h and
+rebuild. #SCHEDULER_OVERFLOW_RESET resets the board on overflow, so with it,
+only the pushes which fit are tested.
+
+Since the kernel is the same for all platforms, you can use this project with
+any platform.
+*/
+
+#include "stdint.h"
+#include "stdio.h"
+#include "string.h"
+// bsp modules required
+#include "board.h"
+#include "leds.h"
+// kernel modules required
+#include "scheduler.h"
+
+//=========================== defines =========================================
+
+#define APP_NUM_LOW         (TASK_LIST_DEPTH-1)  // one container left for cb_unique
+#define APP_MAX_RUNS        (TASK_LIST_DEPTH+1)
+
+enum {
+   APP_TASK_HIGH            = 1,
+   APP_TASK_UNIQUE          = 2,
+   APP_TASK_LOW             = 3,
+};
+
+//=========================== variables =======================================
+
+typedef struct {
+   uint16_t  failedLine;                    // line of the first failing check, 0 if none
+   uint8_t   numLowExpected;                // number of cb_low tasks still pending
+   uint8_t   numRuns;
+   uint8_t   runs[APP_MAX_RUNS];            // APP_TASK_* in the order they ran
+} app_vars_t;
+
+app_vars_t app_vars;
+
+extern scheduler_dbg_t scheduler_dbg;
+
+//=========================== prototypes ======================================
+
+void app_check(bool condition, uint16_t line);
+void app_record(uint8_t task);
+void app_checkRuns();
+
+void cb_high();
+void cb_unique();
+void cb_low();
+
+#define APP_CHECK(condition) app_check((condition),__LINE__)
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main() {
+   uint8_t i;
+   
+   memset(&app_vars,0,sizeof(app_vars_t));
+   
+   board_init();
+   scheduler_init();
+   
+   //=== fill all the task containers
+   
+   for (i=0;i<APP_NUM_LOW;i++) {
+      APP_CHECK(scheduler_push_task(cb_low,TASKPRIO_BUTTON)==E_SUCCESS);
+   }
+   app_vars.numLowExpected = APP_NUM_LOW;
+   
+   // the second unique push is merged, it does not need a container
+   APP_CHECK(scheduler_push_task_unique(cb_unique,TASKPRIO_COAP)==1);
+   APP_CHECK(scheduler_push_task_unique(cb_unique,TASKPRIO_COAP)==2);
+   
+   APP_CHECK(scheduler_dbg.numTasksCur==TASK_LIST_DEPTH);
+   APP_CHECK(scheduler_dbg.numTasksMax==TASK_LIST_DEPTH);
+   APP_CHECK(scheduler_dbg.numCoalesced==1);
+   APP_CHECK(scheduler_dbg.numOverflows==0);
+   
+#if SCHEDULER_OVERFLOW_POLICY!=SCHEDULER_OVERFLOW_RESET
+   //=== overflow
+   
+   // a task of the lowest pending priority, whose callback is pending
+   APP_CHECK(scheduler_push_task(cb_low,TASKPRIO_BUTTON)==E_FAIL);
+   APP_CHECK(scheduler_dbg.numOverflows==1);
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_COALESCE
+   APP_CHECK(scheduler_dbg.numCoalesced==2);
+   APP_CHECK(scheduler_dbg.numRejected==0);
+#else
+   APP_CHECK(scheduler_dbg.numCoalesced==1);
+   APP_CHECK(scheduler_dbg.numRejected==1);
+#endif
+   
+   // a task of a higher priority, whose callback is not pending
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_DROPLOWEST
+   APP_CHECK(scheduler_push_task(cb_high,TASKPRIO_RES)==E_SUCCESS);
+   APP_CHECK(scheduler_dbg.numDropped==1);
+   APP_CHECK(scheduler_dbg.numRejected==1);
+   app_vars.numLowExpected--;
+#else
+   APP_CHECK(scheduler_push_task(cb_high,TASKPRIO_RES)==E_FAIL);
+   APP_CHECK(scheduler_dbg.numDropped==0);
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_COALESCE
+   APP_CHECK(scheduler_dbg.numRejected==1);
+#else
+   APP_CHECK(scheduler_dbg.numRejected==2);
+#endif
+#endif
+   APP_CHECK(scheduler_dbg.numOverflows==2);
+   
+   // a unique push is merged whatever the policy, without overflowing
+   APP_CHECK(scheduler_push_task_unique(cb_unique,TASKPRIO_COAP)==3);
+   APP_CHECK(scheduler_dbg.numOverflows==2);
+   
+   APP_CHECK(scheduler_dbg.numTasksCur==TASK_LIST_DEPTH);
+   APP_CHECK(scheduler_dbg.numTasksMax==TASK_LIST_DEPTH);
+#endif
+   
+   //=== run the tasks, cb_low checks the outcome when the last one runs
+   
+   scheduler_start();
+   return 0; // this line should never be reached
+}
+
+//=========================== callbacks =======================================
+
+void cb_high() {
+   app_record(APP_TASK_HIGH);
+}
+
+void cb_unique() {
+   app_record(APP_TASK_UNIQUE);
+}
+
+void cb_low() {
+   app_record(APP_TASK_LOW);
+   app_vars.numLowExpected--;
+   if (app_vars.numLowExpected==0) {
+      app_checkRuns();
+   }
+}
+
+//=========================== private =========================================
+
+void app_check(bool condition, uint16_t line) {
+   if (condition==FALSE && app_vars.failedLine==0) {
+      app_vars.failedLine = line;
+   }
+}
+
+void app_record(uint8_t task) {
+   if (app_vars.numRuns<APP_MAX_RUNS) {
+      app_vars.runs[app_vars.numRuns] = task;
+   }
+   app_vars.numRuns++;
+}
+
+/**
+\brief Check the tasks ran once each, highest priority first, and report.
+
+Called from the last cb_low task, whose own container is not freed yet.
+*/
+void app_checkRuns() {
+   uint8_t i;
+   
+   i = 0;
+#if SCHEDULER_OVERFLOW_POLICY==SCHEDULER_OVERFLOW_DROPLOWEST
+   APP_CHECK(app_vars.runs[i++]==APP_TASK_HIGH);
+#endif
+   APP_CHECK(app_vars.runs[i++]==APP_TASK_UNIQUE);
+   while (i<app_vars.numRuns && i<APP_MAX_RUNS) {
+      APP_CHECK(app_vars.runs[i++]==APP_TASK_LOW);
+   }
+   
+   APP_CHECK(app_vars.numRuns==TASK_LIST_DEPTH);
+   
+   // all the other containers are free again
+   APP_CHECK(scheduler_dbg.numTasksCur==1);
+   
+   if (app_vars.failedLine==0) {
+      leds_sync_on();
+   } else {
+      leds_error_on();
+   }
+}
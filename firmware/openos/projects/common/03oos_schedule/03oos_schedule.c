@@ -0,0 +1,417 @@
+/**
+\brief This is a program which tests the "schedule" module against a model.
+
+The model keeps the cells in the order they were added, and finds the cell of
+a slot by looking at all of them. Shrinking or deleting a slotframe removes
+its cells past the new end. The program applies a long random sequence
+of adds, removes, slotframe changes and slot advances both to the schedule
+and to the model, and checks after each step that they agree on:
+- the outcome of the adds and removes;
+- whether a cell is scheduled in the current slot and in the next one;
+- the type, neighbor and channel offset of the cell picked for the slot, also
+  after cells are added or removed in the middle of the slot.
+
+A packet to one of the neighbors is queued from time to time, so the cells
+with traffic are picked first.
+
+The sync LED is switched on if all the steps agree; the error LED is switched
+on, and app_vars.failedStep holds the first step which did not, otherwise.
+
+Since the stack modules for different platforms have the same declaration,
+you can use this project with any platform.
+*/
+
+#include "openwsn.h"
+#include "board.h"
+#include "leds.h"
+#include "schedule.h"
+#include "openqueue.h"
+
+//=========================== defines =========================================
+
+#define APP_NUM_STEPS       100000
+#define APP_NUM_NEIGHBORS   3      // neighbors 1..APP_NUM_NEIGHBORS
+#define APP_MAX_OFFSET      5      // cells are at slot offsets 0..APP_MAX_OFFSET-1, so they often share a slot
+
+//=========================== variables =======================================
+
+typedef struct {
+   uint8_t          slotframeHandle;
+   slotOffset_t     slotOffset;
+   cellType_t       type;
+   uint8_t          neighbor;       // last byte of its 64-bit address
+   channelOffset_t  channelOffset;
+} app_cell_t;
+
+typedef struct {
+   uint32_t          failedStep;    // first step which failed, 0 if none
+   uint32_t          step;
+   uint32_t          random;
+   asn_t             asn;
+   frameLength_t     frameLength[MAXSLOTFRAMES];
+   app_cell_t        cells[MAXACTIVESLOTS]; // in the order they were added
+   uint8_t           numCells;
+   OpenQueueEntry_t* pkt;           // the packet queued, NULL if none
+   uint8_t           pktNeighbor;
+   bool              hasCurrent;    // whether current is the cell of the slot
+   app_cell_t        current;       // where the cell of the slot is, and to which neighbor
+} app_vars_t;
+
+app_vars_t app_vars;
+
+//=========================== prototypes ======================================
+
+uint16_t    app_random(uint16_t max);
+void        app_neighbor(open_addr_t* addr, uint8_t neighbor);
+void        app_check(bool condition);
+void        app_checkCurrent();
+void        app_add();
+void        app_remove();
+void        app_setSlotframe();
+void        app_toggleTraffic();
+void        app_advance();
+app_cell_t* app_modelCell(slotOffset_t* offsets);
+bool        app_modelIsActive(slotOffset_t* offsets);
+
+//=========================== main ============================================
+
+/**
+\brief The program starts executing here.
+*/
+int mote_main() {
+   uint8_t i;
+   
+   memset(&app_vars,0,sizeof(app_vars_t));
+   app_vars.random = 0x1234;
+   
+   board_init();
+   openqueue_init();
+   schedule_init();
+   
+   // start from an empty schedule
+   schedule_setSlotframe(SLOTFRAME_DEFAULT,0);
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      app_vars.frameLength[i] = APP_MAX_OFFSET+5*i;
+      schedule_setSlotframe(i,app_vars.frameLength[i]);
+   }
+   
+   for (app_vars.step=1;app_vars.step<=APP_NUM_STEPS;app_vars.step++) {
+      switch (app_random(8)) {
+         case 0:
+            app_add();
+            break;
+         case 1:
+            app_remove();
+            break;
+         case 2:
+            if (app_random(16)==0) {
+               app_setSlotframe();
+            }
+            break;
+         case 3:
+            app_toggleTraffic();
+            break;
+         default:
+            app_advance();
+            break;
+      }
+   }
+   
+   if (app_vars.failedStep==0) {
+      leds_sync_on();
+   } else {
+      leds_error_on();
+   }
+   while (1) {
+      board_sleep();
+   }
+}
+
+//=========================== private =========================================
+
+/**
+\brief A pseudo-random number in [0,max), reproducible from run to run.
+*/
+uint16_t app_random(uint16_t max) {
+   // linear congruential generator, its high bits are the most random
+   app_vars.random = app_vars.random*1103515245+12345;
+   return (uint16_t)(app_vars.random>>16)%max;
+}
+
+void app_neighbor(open_addr_t* addr, uint8_t neighbor) {
+   memset(addr,0,sizeof(open_addr_t));
+   addr->type        = ADDR_64B;
+   addr->addr_64b[7] = neighbor;
+}
+
+void app_check(bool condition) {
+   if (condition==FALSE && app_vars.failedStep==0) {
+      app_vars.failedStep = app_vars.step;
+   }
+}
+
+/**
+\brief Check the schedule still uses the cell picked at the start of the slot.
+*/
+void app_checkCurrent() {
+   app_cell_t* cell;
+   open_addr_t neighbor;
+   uint8_t     i;
+   
+   if (app_vars.hasCurrent==FALSE) {
+      return;
+   }
+   for (i=0;i<app_vars.numCells;i++) {
+      cell = &app_vars.cells[i];
+      if (
+            cell->slotframeHandle==app_vars.current.slotframeHandle &&
+            cell->slotOffset==app_vars.current.slotOffset &&
+            cell->neighbor==app_vars.current.neighbor
+         ) {
+         schedule_getNeighbor(&neighbor);
+         app_check(schedule_getType()==cell->type);
+         app_check(neighbor.type==ADDR_64B && neighbor.addr_64b[7]==cell->neighbor);
+         app_check(schedule_getChannelOffset()==cell->channelOffset);
+         return;
+      }
+   }
+   // it was removed
+   app_vars.hasCurrent = FALSE;
+}
+
+void app_add() {
+   app_cell_t  cell;
+   app_cell_t* existing;
+   open_addr_t neighbor;
+   owerror_t   expected;
+   uint8_t     i;
+   
+   cell.slotframeHandle = app_random(MAXSLOTFRAMES);
+   cell.slotOffset      = app_random(APP_MAX_OFFSET);
+   cell.type            = (app_random(2)==0) ? CELLTYPE_TX : CELLTYPE_RX;
+   cell.neighbor        = 1+app_random(APP_NUM_NEIGHBORS);
+   cell.channelOffset   = app_random(16);
+   app_neighbor(&neighbor,cell.neighbor);
+   
+   // a cell to the same neighbor at the same place is updated
+   existing = NULL;
+   for (i=0;i<app_vars.numCells;i++) {
+      if (
+            app_vars.cells[i].slotframeHandle==cell.slotframeHandle &&
+            app_vars.cells[i].slotOffset==cell.slotOffset &&
+            app_vars.cells[i].neighbor==cell.neighbor
+         ) {
+         existing = &app_vars.cells[i];
+      }
+   }
+   if (existing!=NULL) {
+      existing->type          = cell.type;
+      existing->channelOffset = cell.channelOffset;
+      expected                = E_SUCCESS;
+   } else if (app_vars.numCells<MAXACTIVESLOTS) {
+      app_vars.cells[app_vars.numCells++] = cell;
+      expected                = E_SUCCESS;
+   } else {
+      expected                = E_FAIL;
+   }
+   
+   app_check(schedule_addActiveSlot(
+         cell.slotframeHandle,
+         cell.slotOffset,
+         cell.type,
+         FALSE,
+         cell.channelOffset,
+         &neighbor,
+         FALSE
+      )==expected);
+   app_checkCurrent();
+}
+
+void app_remove() {
+   slotOffset_t slotOffset;
+   uint8_t      slotframeHandle;
+   uint8_t      nbr;
+   open_addr_t  neighbor;
+   owerror_t    expected;
+   uint8_t      i;
+   
+   slotframeHandle = app_random(MAXSLOTFRAMES);
+   slotOffset      = app_random(APP_MAX_OFFSET);
+   nbr             = 1+app_random(APP_NUM_NEIGHBORS);
+   app_neighbor(&neighbor,nbr);
+   
+   expected = E_FAIL;
+   for (i=0;i<app_vars.numCells;i++) {
+      if (
+            app_vars.cells[i].slotframeHandle==slotframeHandle &&
+            app_vars.cells[i].slotOffset==slotOffset &&
+            app_vars.cells[i].neighbor==nbr
+         ) {
+         memmove(&app_vars.cells[i],&app_vars.cells[i+1],(app_vars.numCells-i-1)*sizeof(app_cell_t));
+         app_vars.numCells--;
+         expected = E_SUCCESS;
+         break;
+      }
+   }
+   
+   app_check(schedule_removeActiveSlot(slotframeHandle,slotOffset,&neighbor)==expected);
+   app_checkCurrent();
+}
+
+void app_setSlotframe() {
+   uint8_t       slotframeHandle;
+   frameLength_t frameLength;
+   uint8_t       i;
+   
+   slotframeHandle = app_random(MAXSLOTFRAMES);
+   if (app_random(4)==0) {
+      // delete it
+      frameLength = 0;
+   } else {
+      // cells past the end are removed when it shrinks
+      frameLength = 1+app_random(2*APP_MAX_OFFSET);
+   }
+   i = 0;
+   while (i<app_vars.numCells) {
+      if (
+            app_vars.cells[i].slotframeHandle==slotframeHandle &&
+            app_vars.cells[i].slotOffset>=frameLength
+         ) {
+         memmove(&app_vars.cells[i],&app_vars.cells[i+1],(app_vars.numCells-i-1)*sizeof(app_cell_t));
+         app_vars.numCells--;
+      } else {
+         i++;
+      }
+   }
+   app_vars.frameLength[slotframeHandle] = frameLength;
+   app_vars.hasCurrent = FALSE;
+   
+   app_check(schedule_setSlotframe(slotframeHandle,frameLength)==E_SUCCESS);
+}
+
+void app_toggleTraffic() {
+   if (app_vars.pkt!=NULL) {
+      openqueue_freePacketBuffer(app_vars.pkt);
+      app_vars.pkt = NULL;
+      return;
+   }
+   app_vars.pkt = openqueue_getFreePacketBuffer(COMPONENT_FORWARDING);
+   if (app_vars.pkt==NULL) {
+      return;
+   }
+   app_vars.pktNeighbor = 1+app_random(APP_NUM_NEIGHBORS);
+   app_neighbor(&app_vars.pkt->l2_nextORpreviousHop,app_vars.pktNeighbor);
+   openqueue_resSendToMac(app_vars.pkt);
+}
+
+void app_advance() {
+   slotOffset_t     offsets[MAXSLOTFRAMES];
+   slotOffset_t     next[MAXSLOTFRAMES];
+   app_cell_t*      cell;
+   open_addr_t      neighbor;
+   uint16_t         previous;
+   bool             active;
+   uint8_t          i;
+   
+   if (app_random(64)==0) {
+      // jump to anywhere, as after a resynchronization
+      app_vars.asn.byte4       = app_random(256);
+      app_vars.asn.bytes2and3  = app_random(0xffff);
+      app_vars.asn.bytes0and1  = app_random(0xffff);
+      schedule_syncAsn(&app_vars.asn);
+      active = schedule_advanceSlot(&app_vars.asn);
+   } else {
+      // the MAC may skip a few slots
+      previous                 = app_vars.asn.bytes0and1;
+      app_vars.asn.bytes0and1 += 1+app_random(4);
+      if (app_vars.asn.bytes0and1<previous) {
+         app_vars.asn.bytes2and3++;
+      }
+      active = schedule_advanceSlot(&app_vars.asn);
+   }
+   
+   for (i=0;i<MAXSLOTFRAMES;i++) {
+      if (app_vars.frameLength[i]>0) {
+         offsets[i] = (slotOffset_t)(
+            (
+               (((uint64_t)app_vars.asn.byte4)<<32) +
+               (((uint32_t)app_vars.asn.bytes2and3)<<16) +
+               app_vars.asn.bytes0and1
+            )%app_vars.frameLength[i]
+         );
+         next[i]    = (offsets[i]+1)%app_vars.frameLength[i];
+      }
+   }
+   
+   cell = app_modelCell(offsets);
+   app_check(active==(cell!=NULL));
+   app_vars.hasCurrent = (cell!=NULL);
+   if (cell!=NULL) {
+      app_vars.current = *cell;
+      schedule_getNeighbor(&neighbor);
+      app_check(schedule_getType()==cell->type);
+      app_check(neighbor.type==ADDR_64B && neighbor.addr_64b[7]==cell->neighbor);
+      app_check(schedule_getChannelOffset()==cell->channelOffset);
+   }
+   app_check(schedule_isNextSlotActive()==app_modelIsActive(next));
+}
+
+/**
+\brief The cell the model picks in the slot at some slot offsets.
+
+By increasing slotframe handle, then in the order the cells were added: the
+first cell with a packet to send, else the first cell the mote can receive
+in, else the first cell.
+*/
+app_cell_t* app_modelCell(slotOffset_t* offsets) {
+   app_cell_t* cell;
+   app_cell_t* firstRx;
+   app_cell_t* first;
+   uint8_t     handle;
+   uint8_t     i;
+   
+   firstRx = NULL;
+   first   = NULL;
+   for (handle=0;handle<MAXSLOTFRAMES;handle++) {
+      if (app_vars.frameLength[handle]==0) {
+         continue;
+      }
+      for (i=0;i<app_vars.numCells;i++) {
+         cell = &app_vars.cells[i];
+         if (cell->slotframeHandle!=handle || cell->slotOffset!=offsets[handle]) {
+            continue;
+         }
+         if (
+               cell->type==CELLTYPE_TX &&
+               app_vars.pkt!=NULL &&
+               cell->neighbor==app_vars.pktNeighbor
+            ) {
+            return cell;
+         }
+         if (firstRx==NULL && cell->type!=CELLTYPE_TX) {
+            firstRx = cell;
+         }
+         if (first==NULL) {
+            first   = cell;
+         }
+      }
+   }
+   if (firstRx!=NULL) {
+      return firstRx;
+   }
+   return first;
+}
+
+bool app_modelIsActive(slotOffset_t* offsets) {
+   uint8_t i;
+   
+   for (i=0;i<app_vars.numCells;i++) {
+      if (
+            app_vars.frameLength[app_vars.cells[i].slotframeHandle]>0 &&
+            app_vars.cells[i].slotOffset==offsets[app_vars.cells[i].slotframeHandle]
+         ) {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}